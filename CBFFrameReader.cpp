@@ -0,0 +1,165 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "CBFFrameReader.h"
+#include "MappedFile.h"
+#include "ImageFrame.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define CBF_MAGIC "###CBF"
+
+/* Marks the start of the binary data after its MIME header */
+static const unsigned char cbf_binary_start[] = {0x0c, 0x1a, 0x04, 0xd5};
+
+bool CBFFrameReader::canRead(MappedFilePtr file)
+{
+	size_t length = strlen(CBF_MAGIC);
+
+	return (file->size() > length &&
+	        memcmp(file->bytes(), CBF_MAGIC, length) == 0);
+}
+
+/* Integer value of a MIME header line such as
+ * "X-Binary-Size-Fastest-Dimension: 2463", or -1 if absent */
+static long header_value(const char *header, size_t length, const char *key)
+{
+	std::string text(header, length);
+	size_t pos = text.find(key);
+
+	if (pos == std::string::npos)
+	{
+		return -1;
+	}
+
+	return atol(text.c_str() + pos + strlen(key));
+}
+
+static int32_t read_le16(const unsigned char *p)
+{
+	return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static int32_t read_le32(const unsigned char *p)
+{
+	return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	                 ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+ImageFramePtr CBFFrameReader::read(MappedFilePtr file)
+{
+	unsigned char *bytes = file->bytes();
+	size_t size = file->size();
+	unsigned char *start = NULL;
+
+	for (size_t i = 0; i + sizeof(cbf_binary_start) <= size; i++)
+	{
+		if (memcmp(bytes + i, cbf_binary_start,
+		           sizeof(cbf_binary_start)) == 0)
+		{
+			start = bytes + i;
+			break;
+		}
+	}
+
+	if (start == NULL)
+	{
+		_error = file->getFilename() + ": no binary section.";
+		return ImageFramePtr();
+	}
+
+	const char *header = reinterpret_cast<const char *>(bytes);
+	size_t headerLength = start - bytes;
+
+	if (std::string(header, headerLength).find("x-CBF_BYTE_OFFSET") ==
+	    std::string::npos)
+	{
+		_error = file->getFilename() + ": only byte-offset compression "\
+		"is supported.";
+		return ImageFramePtr();
+	}
+
+	long width = header_value(header, headerLength,
+	                          "X-Binary-Size-Fastest-Dimension:");
+	long height = header_value(header, headerLength,
+	                           "X-Binary-Size-Second-Dimension:");
+	long binarySize = header_value(header, headerLength, "X-Binary-Size:");
+
+	unsigned char *data = start + sizeof(cbf_binary_start);
+	unsigned char *end = bytes + size;
+
+	if (binarySize >= 0 && binarySize <= end - data)
+	{
+		end = data + binarySize;
+	}
+
+	if (width <= 0 || height <= 0)
+	{
+		_error = file->getFilename() + ": missing image dimensions.";
+		return ImageFramePtr();
+	}
+
+	ImageFramePtr frame = ImageFramePtr(new ImageFrame(width, height));
+	int32_t *pixels = frame->data();
+	size_t count = (size_t)width * height;
+	int64_t value = 0;
+	size_t i = 0;
+
+	/* Each pixel is stored as the difference from the one before, in one
+	 * byte if it fits, otherwise escaped to two, four or eight bytes. */
+	while (i < count && data < end)
+	{
+		int64_t delta = (int8_t)data[0];
+		data++;
+
+		if (delta == -128)
+		{
+			if (end - data < 2) break;
+			delta = read_le16(data);
+			data += 2;
+
+			if (delta == -32768)
+			{
+				if (end - data < 4) break;
+				delta = read_le32(data);
+				data += 4;
+
+				if (delta == INT32_MIN)
+				{
+					if (end - data < 8) break;
+					delta = (int64_t)((uint64_t)(uint32_t)read_le32(data) |
+					                  ((uint64_t)(uint32_t)read_le32(data + 4) << 32));
+					data += 8;
+				}
+			}
+		}
+
+		value += delta;
+		pixels[i] = (int32_t)value;
+		i++;
+	}
+
+	if (i < count)
+	{
+		_error = file->getFilename() + ": binary data ends early.";
+		return ImageFramePtr();
+	}
+
+	return frame;
+}
@@ -0,0 +1,36 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__CBFFrameReader__
+#define __Windexing__CBFFrameReader__
+
+#include "FrameReader.h"
+
+/* Crystallographic Binary Format frames with byte-offset compression,
+ * as written by photon-counting detectors. Only the first binary section
+ * is read. */
+
+class CBFFrameReader : public FrameReader
+{
+public:
+	virtual bool canRead(MappedFilePtr file);
+	virtual ImageFramePtr read(MappedFilePtr file);
+};
+
+#endif
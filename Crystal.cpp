@@ -19,10 +19,14 @@
 #include "Crystal.h"
 #include "defaults.h"
 #include "mat3x3.h"
+#include "Trace.h"
+#include "Parallel.h"
 #include <iostream>
-#include "Tinker.h"
-#include <QtCore/qcoreapplication.h>
-	
+#include <algorithm>
+#include <functional>
+#include <float.h>
+#include <atomic>
+
 
 vec3 Crystal::_cube[] = 
 {{-0.5, -0.5, -0.5},
@@ -73,14 +77,27 @@ Crystal::Crystal()
     _unitCell = make_mat3x3();
     _rotation = make_mat3x3();
     _fixedAxis = {0, 0, 0};
+    _redrawFunction = NULL;
+    _redrawObject = NULL;
+    _progressFunction = NULL;
+    _progressObject = NULL;
+    _threads = 0;
+    _trackingValid = false;
+    _trackedAngle = 0;
 
     _horiz = 0;
     _vert = 0;
+    _twist = 0;
     
     for (int i = 0; i < 3; i++) {_cellDims.push_back(1);};
     for (int i = 0; i < 3; i++) {_cellDims.push_back(90);};
 
     _resolution = STARTING_RESOLUTION;
+    _storedResolution = 0;
+    _storedWavelength = STARTING_WAVELENGTH;
+    _storedRlpSize = 0;
+    _turnedSinceStore = 0;
+    _allTransformed = false;
     _rlpSize = 0.0015;
     _wavelength = STARTING_WAVELENGTH;
     _latticeType = BravaisLatticePrimitive;
@@ -89,6 +106,8 @@ Crystal::Crystal()
 void Crystal::setUnitCell(mat3x3 unitCell)
 {
 	_unitCell = unitCell;
+	_trackingValid = false;
+	_storedResolution = 0;
 	mat3x3 real = mat3x3_inverse(unitCell);
 	
 	mat3x3 trans = mat3x3_transpose(real);
@@ -103,14 +122,10 @@ void Crystal::setUnitCell(mat3x3 unitCell)
 	_cellDims[4] = rad2deg(acos(mult.vals[2] / (_cellDims[0] * _cellDims[2])));
 	_cellDims[5] = rad2deg(acos(mult.vals[1] / (_cellDims[0] * _cellDims[1])));
 	
-	std::cout << "Cell dimensions: ";
-
-	for (int i = 0; i < 6; i++)
-	{
-		std::cout << _cellDims[i] << " ";
-	}
-
-	std::cout << std::endl;
+	TRACE_LOG(TraceInfo, "Cell dimensions: " << _cellDims[0] << " "
+	          << _cellDims[1] << " " << _cellDims[2] << " "
+	          << _cellDims[3] << " " << _cellDims[4] << " "
+	          << _cellDims[5]);
 }
 
 void Crystal::setUnitCell(std::vector<double> cellDims)
@@ -122,130 +137,609 @@ void Crystal::setUnitCell(std::vector<double> cellDims)
     populateMillers();
 }
 
-void Crystal::quickCheckMillers()
+ShellTest Crystal::shellTest()
 {
-/* duplicated code - work out best fix */
-
-    std::cout << "Checking " << _reflections.size() << " stored Millers." << std::endl;
-
-    vec3 samplePos = make_vec3(0, 0, - 1 / _wavelength);
     double minLength = 1 / _wavelength - _rlpSize;
     double maxLength = 1 / _wavelength + _rlpSize;
-    double minLengthSq = minLength * minLength;
-    double maxLengthSq = maxLength * maxLength;
     
-	mat3x3 three = getNudge(_horiz, _vert, 0);
+    ShellTest test;
+    test.invWavelength = 1 / _wavelength;
+    test.invRlpSize = 1 / _rlpSize;
+    test.minLengthSq = minLength * minLength;
+    test.maxLengthSq = maxLength * maxLength;
+    
+    return test;
+}
 
-    for (unsigned int i = 0; i < _reflections.size(); i++)
-    {
-		Reflection *refl = &(_reflections[i]);
-        vec3 abc = make_vec3(refl->h, refl->k, refl->l);
+mat3x3 Crystal::combinedMatrix()
+{
+    /* Unit cell, rotation and nudge folded into one matrix */
+	mat3x3 three = getNudge(_horiz, _vert, _twist);
+	mat3x3 rotated = mat3x3_mult_mat3x3(_rotation, _unitCell);
+	
+	return mat3x3_mult_mat3x3(three, rotated);
+}
 
-		mat3x3_mult_vec(_unitCell, &abc);
-		mat3x3_mult_vec(_rotation, &abc);
-		mat3x3_mult_vec(three, &abc);
-        
-        vec3 diff = vec3_subtract_vec3(abc, samplePos);
+void Crystal::quickCheckMillers()
+{
+    TRACE_SCOPE("quickCheckMillers");
+    TRACE_LOG(TraceDebug, "Checking " << _reflections.size()
+              << " stored Millers.");
+
+    ShellTest test = shellTest();
+	mat3x3 combined = combinedMatrix();
+
+	_reflections.checkShell(combined.vals, test);
+	_trackingValid = false;
+	_allTransformed = true;
+}
+
+double Crystal::recheckMiller(int i, mat3x3 &combined, ShellTest &test)
+{
+	vec3 abc = make_vec3(_reflections.h[i], _reflections.k[i],
+	                     _reflections.l[i]);
+	mat3x3_mult_vec(combined, &abc);
+
+	_reflections.x[i] = abc.x;
+	_reflections.y[i] = abc.y;
+	_reflections.z[i] = abc.z;
+
+	double qLength = vec3_length(abc);
+	abc.z += test.invWavelength;
+	double length = vec3_length(abc);
+	double excitation = length - test.invWavelength;
+	double size = fabs(excitation) * test.invRlpSize;
+	bool onImage = (size <= 1);
+
+	_reflections.excitation[i] = excitation;
+	_reflections.weight[i] = (onImage ? size : 1);
+	_reflections.flags[i] = (_reflections.flags[i] & ~ReflectionOnImage) |
+	(onImage ? ReflectionOnImage : 0);
+
+	/* Neither rotating q nor moving the shell changes the excitation
+	 * error by more than |q| times the angle, so this is the smallest
+	 * rotation which could flip the reflection's visibility. */
+	double margin = fabs(_rlpSize - fabs(excitation));
+
+	if (qLength <= 0)
+	{
+		return FLT_MAX;
+	}
+
+	return margin / qLength;
+}
+
+void Crystal::startTracking()
+{
+	ShellTest test = shellTest();
+	mat3x3 combined = combinedMatrix();
+
+	_visible.clear();
+	_crossings.clear();
+	_trackedAngle = 0;
+
+	for (size_t i = 0; i < _reflections.size(); i++)
+	{
+		double angle = recheckMiller(i, combined, test);
+
+		if (shouldDisplayMiller(i))
+		{
+			_visible.push_back(i);
+		}
+		else
+		{
+			_crossings.push_back(std::make_pair(angle, (int)i));
+		}
+	}
+
+	std::make_heap(_crossings.begin(), _crossings.end(),
+	               std::greater<Crossing>());
+	_trackingValid = true;
+	_allTransformed = true;
+}
+
+void Crystal::updateTracking(double angle)
+{
+	_trackedAngle += angle;
+
+	if (!storeCovers(_resolution))
+	{
+		populateMillers();
+		return;
+	}
+
+	/* Only some reflections are moved from here on */
+	_allTransformed = false;
+
+	ShellTest test = shellTest();
+	mat3x3 combined = combinedMatrix();
+
+	std::vector<int> stillVisible;
+	stillVisible.reserve(_visible.size());
+
+	for (size_t j = 0; j < _visible.size(); j++)
+	{
+		int i = _visible[j];
+		double cross = recheckMiller(i, combined, test);
+
+		if (shouldDisplayMiller(i))
+		{
+			stillVisible.push_back(i);
+		}
+		else
+		{
+			_crossings.push_back(std::make_pair(_trackedAngle + cross, i));
+			std::push_heap(_crossings.begin(), _crossings.end(),
+			               std::greater<Crossing>());
+		}
+	}
+
+	/* Only invisible reflections whose margin may have been used up */
+	std::vector<Crossing> reinsert;
+
+	while (_crossings.size() && _crossings.front().first <= _trackedAngle)
+	{
+		std::pop_heap(_crossings.begin(), _crossings.end(),
+		              std::greater<Crossing>());
+		int i = _crossings.back().second;
+		_crossings.pop_back();
+
+		double cross = recheckMiller(i, combined, test);
+
+		if (shouldDisplayMiller(i))
+		{
+			stillVisible.push_back(i);
+		}
+		else
+		{
+			reinsert.push_back(std::make_pair(_trackedAngle + cross, i));
+		}
+	}
+
+	for (size_t j = 0; j < reinsert.size(); j++)
+	{
+		_crossings.push_back(reinsert[j]);
+		std::push_heap(_crossings.begin(), _crossings.end(),
+		               std::greater<Crossing>());
+	}
+
+	_visible.swap(stillVisible);
+}
+
+/* A reflection found during enumeration, before it joins the list */
+typedef struct
+{
+	int h, k, l;
+	vec3 q;
+} Miller;
+
+/* Reflections found by one worker, within the resolution and in the
+ * headroom beyond it. The calling thread's are kept between enumerations
+ * so that their memory is already mapped. */
+typedef struct
+{
+	std::vector<Miller> inside;
+	std::vector<Miller> headroom;
+} MillerBuffer;
+
+static thread_local MillerBuffer caller_buffer;
+
+/* Where one slab's reflections went, so that slabs can be joined in
+ * order whichever worker enumerated them */
+typedef struct
+{
+	int thread;
+	size_t insideStart, insideEnd;
+	size_t headroomStart, headroomEnd;
+} SlabRange;
+
+/* Everything a slab needs to know, copied so that each worker keeps its
+ * own in registers rather than reading the crystal's */
+typedef struct
+{
+	mat3x3 both; // rotation times unit cell
+	mat3x3 unitCell;
+	mat3x3 rotation;
+	vec3 samplePos;
+	double maxRes; // 1 / d at the edge of the headroom
+	double insideRes; // 1 / d at the resolution asked for
+	double minBuffer;
+	double maxBuffer; // squared limits of the buffered shell
+	int bMax;
+	int cMax;
+} SlabSearch;
+
+static void fill_millers(ReflectionList *list, size_t offset,
+                         std::vector<Miller> &millers,
+                         size_t start, size_t end)
+{
+	for (size_t i = start; i < end; i++)
+	{
+		list->set(offset + i - start, millers[i].h, millers[i].k,
+		          millers[i].l, millers[i].q);
+	}
+}
+
+/* Solves a*l^2 + 2*b*l + c <= 0 for l. Returns false if no real l
+ * satisfies it, otherwise fills in the (inclusive) real bounds. */
+static bool quadratic_range(double a, double b, double c,
+                            double *lMin, double *lMax)
+{
+	double disc = b * b - a * c;
+	
+	if (disc < 0 || a <= 0)
+	{
+		return false;
+	}
+	
+	double root = sqrt(disc);
+	*lMin = (-b - root) / a;
+	*lMax = (-b + root) / a;
+	
+	return true;
+}
+
+/* Each (a, b) column is a straight line through reciprocal space,
+ * start + c * step. Only the stretch of line which passes through the
+ * buffered Ewald shell (and lies within resolution) needs checking, and
+ * this is found from the two quadratics in c. */
+static void enumerate_slab(Crystal *crystal, SlabSearch search, int a,
+                           MillerBuffer *millers)
+{
+    vec3 step = mat3x3_axis(search.both, 2);
+    double stepSq = vec3_sqlength(step);
+    double maxRes = search.maxRes;
+
+    for (int b = -search.bMax; b <= search.bMax; b++)
+    {
+        vec3 start = make_vec3(a, b, 0);
+        mat3x3_mult_vec(search.both, &start);
+        vec3 diff = vec3_subtract_vec3(start, search.samplePos);
         
-        double sqLength = vec3_sqlength(diff);
+        double resMin, resMax;
+        double shellMin, shellMax;
         
-        if (sqLength < minLengthSq || sqLength > maxLengthSq)
+        if (!quadratic_range(stepSq, vec3_dot_vec3(start, step),
+                             vec3_sqlength(start) - maxRes * maxRes,
+                             &resMin, &resMax) ||
+            !quadratic_range(stepSq, vec3_dot_vec3(diff, step),
+                             vec3_sqlength(diff) - search.maxBuffer,
+                             &shellMin, &shellMax))
         {
-			refl->onImage = false;
             continue;
         }
         
-        double length = sqrt(sqLength);
-        double size = fabs(1 / _wavelength - length) / (_rlpSize);
-        if (size < 0) size = 0;
-        if (size > 1) size = 1;
-		refl->onImage = true;
-		refl->weight = size;
-		refl->miller = abc;
+        double lMin = std::max(resMin, shellMin);
+        double lMax = std::min(resMax, shellMax);
+        
+        /* Inside the inner surface of the buffer is excluded too */
+        double innerMin = lMax + 1;
+        double innerMax = lMax + 1;
+        quadratic_range(stepSq, vec3_dot_vec3(diff, step),
+                        vec3_sqlength(diff) - search.minBuffer,
+                        &innerMin, &innerMax);
+        
+        /* Rounding outwards; the exact tests below have the final say */
+        int cStart = std::max((int)floor(lMin), -search.cMax);
+        int cEnd = std::min((int)ceil(lMax), search.cMax);
+        int skipStart = (int)ceil(innerMin) + 1;
+        int skipEnd = (int)floor(innerMax) - 1;
+
+        for (int c = cStart; c <= cEnd; c++)
+        {
+            if (c >= skipStart && c <= skipEnd)
+            {
+                c = skipEnd;
+                continue;
+            }
+
+            vec3 abc = make_vec3(a, b, c);
+            
+            bool sysabs = crystal->isSysabs(a, b, c);
+           
+            if (sysabs) continue;
+
+            mat3x3_mult_vec(search.unitCell, &abc);
+            double length = vec3_length(abc);
+
+            if (length > maxRes)
+            {
+                continue;
+            }
+
+            mat3x3_mult_vec(search.rotation, &abc);
+            
+            vec3 diff = vec3_subtract_vec3(abc, search.samplePos);
+            
+            double sqLength = vec3_sqlength(diff);
+
+            if (sqLength < search.minBuffer || sqLength > search.maxBuffer)
+            {
+                continue;
+            }
+
+            if (length > search.insideRes)
+            {
+                millers->headroom.push_back(Miller{a, b, c, abc});
+                continue;
+            }
+
+            millers->inside.push_back(Miller{a, b, c, abc});
+        }
     }
 }
 
 void Crystal::populateMillers()
 {
-    std::cout << "Populating millers" << std::endl;
+    TRACE_SCOPE("populateMillers");
+    TRACE_LOG(TraceDebug, "Populating millers");
     _reflections.clear();
-    int aMax = _cellDims[0] / _resolution;
-    int bMax = _cellDims[1] / _resolution;
-    int cMax = _cellDims[2] / _resolution;
-    vec3 samplePos = make_vec3(0, 0, - 1 / _wavelength);
+    _watched.clear();
+    double reach = storageResolution();
+    int aMax = _cellDims[0] / reach;
     double minLength = 1 / _wavelength - _rlpSize;
     double maxLength = 1 / _wavelength + _rlpSize;
     double minLengthSq = minLength * minLength;
     double maxLengthSq = maxLength * maxLength;
     maxLength += _rlpSize * 2;
     minLength -= _rlpSize * 2;
-    double minBuffer = minLength * minLength;
-    double maxBuffer = maxLength * maxLength; 
 
-    std::cout << minLengthSq << " " << maxLengthSq << std::endl;
-    std::cout << "To maximum resolution: " << _resolution << std::endl;
-    
-    for (int a = -aMax; a <= aMax; a++)
+    SlabSearch search;
+    search.both = mat3x3_mult_mat3x3(_rotation, _unitCell);
+    search.unitCell = _unitCell;
+    search.rotation = _rotation;
+    search.samplePos = make_vec3(0, 0, - 1 / _wavelength);
+    search.maxRes = 1 / reach;
+    search.insideRes = 1 / _resolution;
+    search.minBuffer = minLength * minLength;
+    search.maxBuffer = maxLength * maxLength;
+    search.bMax = _cellDims[1] / reach;
+    search.cMax = _cellDims[2] / reach;
+
+    TRACE_LOG(TraceDebug, minLengthSq << " " << maxLengthSq);
+    TRACE_LOG(TraceDebug, "To maximum resolution: " << _resolution
+              << " (stored to " << reach << ")");
+
+    size_t slabCount = 2 * aMax + 1;
+    size_t columns = slabCount * (2 * search.bMax + 1);
+    std::atomic<size_t> slabsDone(0);
+    int reported = -1;
+
+    int threads = (_threads > 0 ? _threads : thread_count());
+    bool report = (_progressFunction != NULL &&
+                   columns >= PROGRESS_MIN_COLUMNS);
+
+    if (columns < PARALLEL_MIN_COLUMNS)
+    {
+        threads = 1;
+    }
+
+    /* Slabs of constant a are handed out to workers, which each add to
+     * their own buffers and note where every slab went */
+    std::vector<MillerBuffer> buffers(threads);
+    std::vector<SlabRange> ranges(slabCount);
+    buffers[0].inside.swap(caller_buffer.inside);
+    buffers[0].headroom.swap(caller_buffer.headroom);
+    buffers[0].inside.clear();
+    buffers[0].headroom.clear();
+
+    parallel_for(slabCount, threads, [&](size_t slab, int t)
     {
-        for (int b = -bMax; b <= bMax; b++)
+        MillerBuffer &buffer = buffers[t];
+        SlabRange &range = ranges[slab];
+        range.thread = t;
+        range.insideStart = buffer.inside.size();
+        range.headroomStart = buffer.headroom.size();
+
+        enumerate_slab(this, search, (int)slab - aMax, &buffer);
+
+        range.insideEnd = buffer.inside.size();
+        range.headroomEnd = buffer.headroom.size();
+        size_t done = ++slabsDone;
+
+        /* Only the calling thread may talk to the front end */
+        int percent = done * 100 / slabCount;
+
+        if (t == 0 && report && percent > reported)
         {
-            for (int c = -cMax; c <= cMax; c++)
-            {
-                vec3 abc = make_vec3(a, b, c);
-                
-                bool sysabs = isSysabs(a, b, c);
-               
-                if (sysabs) continue;
-
-                mat3x3_mult_vec(_unitCell, &abc);
-				double length = vec3_length(abc);
-
-				if (length > 1 / _resolution)
-				{
-					continue;
-				}
-
-                mat3x3_mult_vec(_rotation, &abc);
-                
-                vec3 diff = vec3_subtract_vec3(abc, samplePos);
-                
-                double sqLength = vec3_sqlength(diff);
-
-                if (sqLength < minBuffer || sqLength > maxBuffer)
-                {
-					continue;
-                }
-
-				Reflection refl;
-				refl.miller = abc;
-				refl.h = a;
-				refl.k = b;
-				refl.l = c;
-				refl.weight = 0;
-				refl.onImage = false;
-				refl.watched = false;
-				_reflections.push_back(refl);
-			}
+            reported = percent;
+            (*_progressFunction)(_progressObject, done / (double)slabCount);
         }
+    });
+
+    if (report && reported < 100)
+    {
+        (*_progressFunction)(_progressObject, 1);
+    }
+
+    /* Joined in slab order, so the result doesn't depend on the threads,
+     * with the headroom at the end so that no sorting is needed until the
+     * resolution actually changes */
+    std::vector<size_t> insideOffset(slabCount);
+    std::vector<size_t> headroomOffset(slabCount);
+    size_t count = 0;
+
+    for (size_t i = 0; i < slabCount; i++)
+    {
+        insideOffset[i] = count;
+        count += ranges[i].insideEnd - ranges[i].insideStart;
+    }
+
+    size_t total = count;
+
+    for (size_t i = 0; i < slabCount; i++)
+    {
+        headroomOffset[i] = total;
+        total += ranges[i].headroomEnd - ranges[i].headroomStart;
     }
+
+    _reflections.resize(total);
+
+    parallel_for(slabCount, threads, [&](size_t slab, int)
+    {
+        SlabRange &range = ranges[slab];
+        MillerBuffer &buffer = buffers[range.thread];
+        fill_millers(&_reflections, insideOffset[slab], buffer.inside,
+                     range.insideStart, range.insideEnd);
+        fill_millers(&_reflections, headroomOffset[slab], buffer.headroom,
+                     range.headroomStart, range.headroomEnd);
+    });
+
+    buffers[0].inside.swap(caller_buffer.inside);
+    buffers[0].headroom.swap(caller_buffer.headroom);
+
+    _reflections.setActiveCount(count);
+    _storedResolution = reach;
+    _storedWavelength = _wavelength;
+    _storedRlpSize = _rlpSize;
+    _turnedSinceStore = 0;
     
     quickCheckMillers();
     
-    std::cout << "Found " << _reflections.size() << " reflections." << std::endl;
+    TRACE_LOG(TraceDebug, "Found " << _reflections.size() << " reflections ("
+              << _reflections.storedSize() << " stored).");
 }
 
-mat3x3 Crystal::getNudge(double diffX, double diffY, double diffZ)
+/* Roughly how many reflections lie within a resolution of the buffered
+ * shell: the shell passes through the origin, so the part within 1 / d
+ * of it has area pi / d^2, and its thickness is six rlp sizes. */
+double Crystal::storageResolution()
+{
+    double reach = _resolution / RESOLUTION_HEADROOM;
+    double cellVolume = 1 / mat3x3_determinant(_unitCell);
+    double estimate = M_PI / (reach * reach) * 6 * _rlpSize * fabs(cellVolume);
+
+    if (estimate > MAX_STORED_REFLECTIONS)
+    {
+        return _resolution;
+    }
+
+    return reach;
+}
+
+/* Whether the stored reflections include every one, out to this
+ * resolution, which could be within the current shell. They were stored
+ * within a buffer of two rlp sizes either side of the shell at the time.
+ * A point moves relative to the sample by at most |q| times the angle
+ * turned, and its distance from the sample changes by at most the shift
+ * in 1 / lambda, which also moves the shell surface by as much. */
+bool Crystal::storeCovers(double resolution)
+{
+    if (_storedResolution <= 0 || resolution < _storedResolution)
+    {
+        return false;
+    }
+
+    double shift = fabs(1 / _wavelength - 1 / _storedWavelength);
+    double margin = 3 * _storedRlpSize - _rlpSize - 2 * shift;
+
+    return (_turnedSinceStore * (1 / resolution) < margin);
+}
+
+bool Crystal::sliceToResolution()
+{
+    /* Stored reflections outside the resolution are not tracked, so
+     * must still cover the shell out to where they were stored */
+    if (_resolution < _storedResolution || !storeCovers(_storedResolution))
+    {
+        return false;
+    }
+
+    /* Sorting moves the reflections, so the watched ones are found again
+     * from their flags */
+    _reflections.sortByResolution();
+    size_t count = _reflections.countWithin(1 / (_resolution * _resolution));
+    _reflections.setActiveCount(count);
+    _trackingValid = false;
+    _watched.clear();
+
+    for (size_t i = 0; i < _reflections.storedSize(); i++)
+    {
+        if (!(_reflections.flags[i] & ReflectionWatched))
+        {
+            continue;
+        }
+
+        if (i < count)
+        {
+            _watched.push_back(i);
+        }
+        else
+        {
+            _reflections.flags[i] &= ~(ReflectionWatched | ReflectionObserved);
+        }
+    }
+
+    return true;
+}
+
+void Crystal::refreshShell()
+{
+    if (!storeCovers(_resolution))
+    {
+        populateMillers();
+        return;
+    }
+
+    /* Reflections not moved by tracking still hold an older q.z */
+    if (!_allTransformed)
+    {
+        quickCheckMillers();
+        return;
+    }
+
+    TRACE_SCOPE("refreshShell");
+    ShellTest test = shellTest();
+    _reflections.recheckShell(test);
+    _trackingValid = false;
+}
+
+void Crystal::applyWavelength(double wavelength)
+{
+    setWavelength(wavelength);
+    refreshShell();
+}
+
+void Crystal::applyRlpSize(double rlpSize)
+{
+    setRlpSize(rlpSize);
+    refreshShell();
+}
+
+void Crystal::applyResolution(double resolution)
+{
+    TRACE_SCOPE("applyResolution");
+    setResolution(resolution);
+
+    if (!sliceToResolution())
+    {
+        populateMillers();
+        return;
+    }
+
+    quickCheckMillers();
+    TRACE_LOG(TraceDebug, "Using " << _reflections.size() << " of "
+              << _reflections.storedSize() << " stored reflections.");
+}
+
+void Crystal::nudgeAxes(vec3 *xAxis, vec3 *yAxis, vec3 *zAxis)
 {
-    vec3 xAxis = {1, 0, 0};
-    vec3 yAxis = {0, 1, 0};
-    vec3 zAxis = {0, 0, 1};
+    *xAxis = make_vec3(1, 0, 0);
+    *yAxis = make_vec3(0, 1, 0);
+    *zAxis = make_vec3(0, 0, 1);
     
     if (vec3_length(_fixedAxis) > 0.5)
     {
-        xAxis = _fixedAxis;
-        yAxis = vec3_cross_vec3(_fixedAxis, zAxis);
-        vec3_set_length(&yAxis, 1);
+        *xAxis = _fixedAxis;
+        *yAxis = vec3_cross_vec3(_fixedAxis, *zAxis);
+        vec3_set_length(yAxis, 1);
     }
+}
+
+mat3x3 Crystal::getNudge(double diffX, double diffY, double diffZ)
+{
+    vec3 xAxis, yAxis, zAxis;
+    nudgeAxes(&xAxis, &yAxis, &zAxis);
     
     mat3x3 xRot = mat3x3_unit_vec_rotation(yAxis, diffX);
     mat3x3 yRot = mat3x3_unit_vec_rotation(xAxis, diffY);
@@ -257,15 +751,69 @@ mat3x3 Crystal::getNudge(double diffX, double diffY, double diffZ)
     return three;
 }
 
+void Crystal::rotationDerivatives(int i, vec3 *dHoriz, vec3 *dVert,
+                                  vec3 *dTwist)
+{
+    vec3 xAxis, yAxis, zAxis;
+    nudgeAxes(&xAxis, &yAxis, &zAxis);
+    
+    mat3x3 xRot = mat3x3_unit_vec_rotation(yAxis, _horiz);
+    mat3x3 yRot = mat3x3_unit_vec_rotation(xAxis, _vert);
+    mat3x3 zRot = mat3x3_unit_vec_rotation(zAxis, _twist);
+    
+    /* The nudge is zRot.yRot.xRot; differentiating each rotation in turn
+     * gives its axis crossed with the vector it acts on. */
+    vec3 p = make_vec3(_reflections.h[i], _reflections.k[i],
+                       _reflections.l[i]);
+    mat3x3 rotated = mat3x3_mult_mat3x3(_rotation, _unitCell);
+    mat3x3_mult_vec(rotated, &p);
+    
+    mat3x3_mult_vec(xRot, &p);
+    *dHoriz = vec3_cross_vec3(yAxis, p);
+    mat3x3_mult_vec(yRot, dHoriz);
+    mat3x3_mult_vec(zRot, dHoriz);
+    
+    mat3x3_mult_vec(yRot, &p);
+    *dVert = vec3_cross_vec3(xAxis, p);
+    mat3x3_mult_vec(zRot, dVert);
+    
+    mat3x3_mult_vec(zRot, &p);
+    *dTwist = vec3_cross_vec3(zAxis, p);
+}
+
+/* Angle turned through by a rotation matrix */
+static double rotation_angle(const mat3x3 &mat)
+{
+    double trace = mat.vals[0] + mat.vals[4] + mat.vals[8];
+    double cosine = std::max(-1., std::min(1., (trace - 1) / 2));
+    return acos(cosine);
+}
+
+void Crystal::turnTo(mat3x3 rotation)
+{
+    mat3x3 change = mat3x3_mult_mat3x3(rotation, mat3x3_transpose(_rotation));
+    _turnedSinceStore += rotation_angle(change);
+    _rotation = rotation;
+    _trackingValid = false;
+    _allTransformed = false;
+}
+
 void Crystal::applyRotation(double diffX, double diffY, double diffZ)
 {
     mat3x3 three = getNudge(diffX, diffY, diffZ);
     
+    if (!_trackingValid)
+    {
+        startTracking();
+    }
+    
     _rotation = mat3x3_mult_mat3x3(three, _rotation);
     
-    quickCheckMillers();
+    double angle = rotation_angle(three);
+    _turnedSinceStore += angle;
+    updateTracking(angle);
     
-    std::cout << mat3x3_desc(_rotation) << std::endl;
+    TRACE_LOG(TraceDebug, mat3x3_desc(_rotation));
 }
 
 void Crystal::bringAxisToScreen(std::vector<double> newAxis)
@@ -290,8 +838,8 @@ void Crystal::bringAxisToScreen(std::vector<double> newAxis)
     vec3 screenAxis = make_vec3(1, 0, 0);
     
         
-    std::cout << "Mapping reciprocal axis " << vec3_desc(axis)
-    << " to screen axis " << vec3_desc(screenAxis) << std::endl;
+    TRACE_LOG(TraceInfo, "Mapping reciprocal axis " << vec3_desc(axis)
+              << " to screen axis " << vec3_desc(screenAxis));
     
     _rotation = mat3x3_map_vec_to_vec(axis, screenAxis);
     
@@ -304,7 +852,7 @@ void Crystal::bringAxisToScreen(std::vector<double> newAxis)
     }
 
     
-    std::cout << "Rotation: " << mat3x3_desc(_rotation) << std::endl;
+    TRACE_LOG(TraceInfo, "Rotation: " << mat3x3_desc(_rotation));
     
     populateMillers();
 }
@@ -317,27 +865,79 @@ mat3x3 Crystal::getScaledBasisVectors()
     return inverse;
 }
 
+void Crystal::toggleWatched(int i)
+{
+	_reflections.flags[i] ^= ReflectionWatched;
+
+	if (_reflections.flags[i] & ReflectionWatched)
+	{
+		_watched.push_back(i);
+	}
+	else
+	{
+		_reflections.flags[i] &= ~ReflectionObserved;
+		_watched.erase(std::find(_watched.begin(), _watched.end(), i));
+	}
+}
+
+void Crystal::setObservedPosition(int i, double x, double y)
+{
+	_reflections.obsX[i] = x;
+	_reflections.obsY[i] = y;
+	_reflections.flags[i] |= ReflectionObserved;
+}
+
 bool Crystal::isBeingWatched(int i)
 {
-	return _reflections[i].watched;
+	return (_reflections.flags[i] & ReflectionWatched);
+}
+
+void Crystal::recheckWatched()
+{
+	TRACE_SCOPE("recheckWatched");
+    /* Only the watched reflections contribute, so only they are moved;
+     * the full set catches up in clearUpRefinement. */
+    ShellTest test = shellTest();
+    mat3x3 combined = combinedMatrix();
+    _trackingValid = false;
+    _allTransformed = false;
+
+	for (size_t j = 0; j < _watched.size(); j++)
+	{
+		recheckMiller(_watched[j], combined, test);
+	}
+
+	if (_redrawFunction != NULL)
+	{
+		(*_redrawFunction)(_redrawObject);
+	}
+}
+
+void Crystal::keepWatchedOnly()
+{
+	_reflections.keep(_watched);
+
+	for (size_t j = 0; j < _watched.size(); j++)
+	{
+		_watched[j] = j;
+	}
+
+	_trackingValid = false;
+	_storedResolution = 0;
+	_allTransformed = false;
 }
 
 double Crystal::ewaldSphereCloseness()
 {
-    quickCheckMillers();
+    TRACE_SCOPE("ewaldSphereCloseness");
+    recheckWatched();
     
     double sizeSum = 0;
-	int count = 0;
+	int count = _watched.size();
 
-	for (unsigned int i = 0; i < _reflections.size(); i++)
+	for (size_t j = 0; j < _watched.size(); j++)
 	{
-		if (!_reflections[i].watched)
-		{
-			continue;
-		}
-
-		sizeSum += _reflections[i].weight;
-		count++;
+		sizeSum += _reflections.weight[_watched[j]];
 	}
 
 	if (count == 0)
@@ -347,24 +947,37 @@ double Crystal::ewaldSphereCloseness()
 
 	sizeSum /= (double)count;
 
-    std::cout << "Ewald sphere closeness check " << sizeSum <<
-	" across " << count << " reflections." << std::endl;
+    TRACE_LOG(TraceDebug, "Ewald sphere closeness check " << sizeSum <<
+	          " across " << count << " reflections.");
 
-    _tinker->drawPredictions();
-	QCoreApplication::processEvents();
-    
 	return sizeSum;
 }
 
 void Crystal::clearUpRefinement()
 {
-    mat3x3 three = getNudge(_horiz, _vert, 0);
+    mat3x3 three = getNudge(_horiz, _vert, _twist);
     _rotation = mat3x3_mult_mat3x3(three, _rotation);
+    _turnedSinceStore += rotation_angle(three);
     _horiz = 0;
     _vert = 0;
+    _twist = 0;
+
+	for (size_t j = 0; j < _watched.size(); j++)
+	{
+		_reflections.flags[_watched[j]] &= ~(ReflectionWatched |
+		                                     ReflectionObserved);
+	}
 
-	for (unsigned int i = 0; i < _reflections.size(); i++)
+	_watched.clear();
+
+	/* Enumerating again is only needed once the refinement has turned
+	 * the crystal too far for the stored reflections */
+	if (storeCovers(_resolution))
+	{
+		quickCheckMillers();
+	}
+	else
 	{
-		_reflections[i].watched = false;
+		populateMillers();
 	}
 }
@@ -21,23 +21,37 @@
 #include "mat3x3.h"
 #include <iostream>
 #include "shared_ptrs.h"
+#include "ReflectionList.h"
+#include <vector>
+#include <utility>
 
 #define STARTING_WAVELENGTH 1.000
 #define STARTING_DISTANCE 500.000
 
-typedef struct
-{
-	vec3 miller; // the transformed coordinates in reciprocal space
-	vec3 position; // updated by detector when needed
-	int h;
-	int k;
-	int l; // before transformation on a integer grid
-	double weight; // proportional to closeness to Ewald sphere
-	bool onImage; // whether it is to be displayed on overlay
-	bool watched;
-} Reflection;
-
-class Tinker;
+/* Reflections are enumerated this much further out in |q| than the
+ * resolution asks for, so that small steps in either direction don't need
+ * a new enumeration... */
+#define RESOLUTION_HEADROOM 1.1
+/* ...unless that would store more than about this many */
+#define MAX_STORED_REFLECTIONS 1000000
+
+/* Enumerations visiting fewer (h, k) columns than this stay on one
+ * thread, as starting more would cost more than it saves */
+#define PARALLEL_MIN_COLUMNS 20000
+
+/* ...and those visiting fewer than this are too quick to report progress */
+#define PROGRESS_MIN_COLUMNS 250000
+
+
+/* Rotation angle at which a reflection could next change visibility */
+typedef std::pair<double, int> Crossing;
+
+/* Called during refinement so that a front end can show progress */
+typedef void (*Notifier)(void *);
+
+/* Called with the fraction done during a long enumeration, always from
+ * the thread which started it */
+typedef void (*ProgressNotifier)(void *, double fraction);
 
 class Crystal
 {
@@ -61,6 +75,20 @@ public:
         return static_cast<Crystal *>(crystal)->ewaldSphereCloseness();
     }
    
+    /* Independent copies for evaluating in parallel */
+    static void *cloneCrystal(void *crystal)
+    {
+        Crystal *copy = new Crystal(*static_cast<Crystal *>(crystal));
+        copy->setRedrawFunction(NULL, NULL);
+        copy->setProgressFunction(NULL, NULL);
+        return copy;
+    }
+    
+    static void deleteCrystal(void *crystal)
+    {
+        delete static_cast<Crystal *>(crystal);
+    }
+
     static void setHorizontal(void *crystal, double horiz)
     {
         static_cast<Crystal *>(crystal)->_horiz = horiz;
@@ -71,6 +99,16 @@ public:
         static_cast<Crystal *>(crystal)->_vert = vert;
     }
     
+    static void setTwist(void *crystal, double twist)
+    {
+        static_cast<Crystal *>(crystal)->_twist = twist;
+    }
+    
+    static double getTwist(void *crystal)
+    {
+        return static_cast<Crystal *>(crystal)->_twist;
+    }
+    
     static double getVertical(void *crystal)
     {
         return static_cast<Crystal *>(crystal)->_vert;
@@ -85,11 +123,22 @@ public:
     void setResolution(double resolution)
     {
         _resolution = resolution;
+        _trackingValid = false;
     }
+
+    /* Sets the resolution and updates the reflections, cutting the
+     * stored list down where possible rather than enumerating again */
+    void applyResolution(double resolution);
+
+    /* Set the wavelength or rlp size and update the reflections, from
+     * their stored |q| and q.z where the stored list still covers the
+     * new shell */
+    void applyWavelength(double wavelength);
+    void applyRlpSize(double rlpSize);
     
-    Reflection *refl(int i)
+    ReflectionList *reflections()
     {
-        return &_reflections[i];
+        return &_reflections;
     }
     
     size_t millerCount()
@@ -100,40 +149,62 @@ public:
     vec3 miller(int i)
     {
         //Transformed into reciprocal space. Already fractional.
-        return _reflections[i].miller;
+        return make_vec3(_reflections.x[i], _reflections.y[i],
+                         _reflections.z[i]);
     }
 
 	void setPositionForMiller(int i, vec3 pos)
 	{
-		_reflections[i].position = pos;
+		_reflections.posX[i] = pos.x;
+		_reflections.posY[i] = pos.y;
+		_reflections.posZ[i] = pos.z;
 	}
 
 	vec3 position(int i)
 	{
-		return _reflections[i].position;
+		return make_vec3(_reflections.posX[i], _reflections.posY[i],
+		                 _reflections.posZ[i]);
 	}
 
-	void toggleWatched(int i)
+	void toggleWatched(int i);
+
+	/* Detector position (pixels) at which a watched reflection was
+	 * measured, for refinement of the geometry */
+	void setObservedPosition(int i, double x, double y);
+
+	std::vector<int> &watchedReflections()
 	{
-		_reflections[i].watched = ((_reflections[i].watched == 0) ? 1 : 0);
+		return _watched;
 	}
+
+	/* Moves only the watched reflections to the current orientation */
+	void recheckWatched();
+
+	/* Drops every reflection but the watched ones, which is all that
+	 * refinement looks at, so that copies for evaluating in parallel
+	 * are cheap to make */
+	void keepWatchedOnly();
+
+	/* Change in the reciprocal lattice point of reflection i per radian
+	 * of each of the refinement nudges, at their current values. */
+	void rotationDerivatives(int i, vec3 *dHoriz, vec3 *dVert, vec3 *dTwist);
     
     void getMillerHKL(int i, int *h, int *k, int *l)
     {
-        *h = _reflections[i].h;
-        *k = _reflections[i].k;
-        *l = _reflections[i].l;
+        *h = _reflections.h[i];
+        *k = _reflections.k[i];
+        *l = _reflections.l[i];
     }
     
 
     double weightForMiller(int i)
     {
-        return _reflections[i].weight;
+        return _reflections.weight[i];
     }
 
 	bool shouldDisplayMiller(int i)
 	{
-		return _reflections[i].onImage;
+		return (_reflections.flags[i] & ReflectionOnImage);
 	}
     
     void setFixedAxis(vec3 axis)
@@ -146,9 +217,15 @@ public:
         return _fixedAxis;
     }
     
+    double getWavelength()
+    {
+        return _wavelength;
+    }
+    
     void setWavelength(double wavelength)
     {
         _wavelength = wavelength;
+        _trackingValid = false;
     }
     
     double getRlpSize()
@@ -159,12 +236,26 @@ public:
     void setRlpSize(double rlpSize)
     {
         _rlpSize = rlpSize;
+        _trackingValid = false;
     }
     
     
-    void setTinker(Tinker *tinker)
+    void setRedrawFunction(Notifier function, void *object)
+    {
+        _redrawFunction = function;
+        _redrawObject = object;
+    }
+
+    void setProgressFunction(ProgressNotifier function, void *object)
+    {
+        _progressFunction = function;
+        _progressObject = object;
+    }
+
+    /* Threads for enumerating reflections; zero for thread_count() */
+    void setThreads(int threads)
     {
-        _tinker = tinker;
+        _threads = threads;
     }
     
     mat3x3 getRotation()
@@ -172,9 +263,16 @@ public:
         return _rotation;
     }
     
+    /* Sets a rotation close to the current one. Unlike setRotation, the
+     * stored reflections are kept for as long as they cover the shell. */
+    void turnTo(mat3x3 rotation);
+
     void setRotation(mat3x3 rot)
     {
         _rotation = rot;
+        _trackingValid = false;
+        _storedResolution = 0;
+        _allTransformed = false;
     }
     
     mat3x3 getUnitCell()
@@ -184,28 +282,58 @@ public:
     
     void setUnitCell(mat3x3 unitCell);
 
+    bool isSysabs(int a, int b, int c);
+
     void setBravaisLattice(BravaisLatticeType type)
     {
         _latticeType = type;
+        _storedResolution = 0;
     }
 
 private:
     double ewaldSphereCloseness();
-    bool isSysabs(int a, int b, int c);
-    Tinker *_tinker;
+    void nudgeAxes(vec3 *xAxis, vec3 *yAxis, vec3 *zAxis);
+    ShellTest shellTest();
+    mat3x3 combinedMatrix();
+    double recheckMiller(int i, mat3x3 &combined, ShellTest &test);
+    void startTracking();
+    void updateTracking(double angle);
+    double storageResolution();
+    bool storeCovers(double resolution);
+    bool sliceToResolution();
+    void refreshShell();
+    Notifier _redrawFunction;
+    void *_redrawObject;
+    ProgressNotifier _progressFunction;
+    void *_progressObject;
+    int _threads;
 
     std::vector<double> _cellDims;
     mat3x3 _rotation;
     mat3x3 _unitCell;
 
-	std::vector<Reflection> _reflections;
+	ReflectionList _reflections;
+	std::vector<int> _watched; // indices of reflections used in refinement
+
+	/* Incremental visibility for small rotations: which reflections are
+	 * on image, and a min-heap of when the others could next cross */
+	bool _trackingValid;
+	double _trackedAngle;
+	std::vector<int> _visible;
+	std::vector<Crossing> _crossings;
 
     double _resolution;
+    double _storedResolution; // reach of the stored reflections, 0 if stale
+    double _storedWavelength;
+    double _storedRlpSize; // shell about which they were stored
+    double _turnedSinceStore; // rotation (radians) since they were stored
+    bool _allTransformed; // every active reflection at current orientation
     double _rlpSize;
     double _wavelength;
     
     double _horiz;
     double _vert;
+    double _twist; // about the beam
     BravaisLatticeType _latticeType;
     
     static vec3 _cube[8];
@@ -19,149 +19,293 @@
 #include "Crystal.h"
 #include "Detector.h"
 #include "defaults.h"
+#include "Trace.h"
 #include <iostream>
 #include "float.h"
+#include <math.h>
 
 Detector::Detector()
 {
     _beamCentre = make_vec3(-1, -1, STARTING_DISTANCE);
     _wavelength = STARTING_WAVELENGTH;
-	_lookupTree = NULL;
+	_lookupDirty = true;
+	_flatPanel = make_flat_panel();
 }
 
 void Detector::calculatePositions()
 {
+	TRACE_SCOPE("calculatePositions");
 	vec3 samplePos = make_vec3(0, 0, - 1 / _wavelength);
+	ReflectionList *refls = _xtal->reflections();
 
-	for (size_t i = 0; i < _xtal->millerCount(); i++)
+	if (refls->size() && _panels.size())
 	{
-		vec3 miller = _xtal->miller(i);
+		/* Reflections between panels are taken off the image here */
+		if (refls->getPrecision() == PrecisionSingle)
+		{
+			panel_project_vecs<float>(&refls->x[0], &refls->y[0], &refls->z[0],
+			                          refls->size(), samplePos, _beamCentre,
+			                          &_panels[0], _panels.size(),
+			                          &refls->flags[0], ReflectionOnImage,
+			                          &refls->posX[0], &refls->posY[0],
+			                          &refls->posZ[0], &refls->panel[0]);
+		}
+		else
+		{
+			panel_project_vecs<double>(&refls->x[0], &refls->y[0], &refls->z[0],
+			                           refls->size(), samplePos, _beamCentre,
+			                           &_panels[0], _panels.size(),
+			                           &refls->flags[0], ReflectionOnImage,
+			                           &refls->posX[0], &refls->posY[0],
+			                           &refls->posZ[0], &refls->panel[0]);
+		}
+	}
+	else if (refls->size())
+	{
+		/* Off-image reflections keep their stale coordinates */
+		if (refls->getPrecision() == PrecisionSingle)
+		{
+			vec3_project_vecs<float>(&refls->x[0], &refls->y[0], &refls->z[0],
+			                         refls->size(), samplePos, _beamCentre.z,
+			                         &refls->flags[0], ReflectionOnImage,
+			                         &refls->posX[0], &refls->posY[0],
+			                         &refls->posZ[0]);
+		}
+		else
+		{
+			vec3_project_vecs<double>(&refls->x[0], &refls->y[0], &refls->z[0],
+			                          refls->size(), samplePos, _beamCentre.z,
+			                          &refls->flags[0], ReflectionOnImage,
+			                          &refls->posX[0], &refls->posY[0],
+			                          &refls->posZ[0]);
+		}
+	}
 
-		vec3 diff = vec3_subtract_vec3(miller, samplePos);
-		double mult = _beamCentre.z / diff.z;
-        vec3_mult(&diff, mult);
-        
-		_xtal->setPositionForMiller(i, diff);
-    }
+	_lookupDirty = true;
 }
 
-double Detector::distToMiller(int i, int x, int y)
+int Detector::positionNearCoord(int x, int y)
 {
-	vec3 pos = _xtal->position(i);
-	vec3 clickPos = make_vec3(x, y, pos.z);
-	vec3 diff = vec3_subtract_vec3(clickPos, pos);
-	
-	return vec3_length(diff);
+	x -= _beamCentre.x;
+	y -= _beamCentre.y;
+
+	if (_lookupDirty)
+	{
+		prepareLookupTable();
+	}
+
+	return _lookupGrid.nearest(x, y, CLOSENESS);
 }
 
-bool Detector::nearMiller(int i, int x, int y)
+void Detector::prepareLookupTable()
 {
-	bool onImage = _xtal->shouldDisplayMiller(i);
+	TRACE_SCOPE("prepareLookupTable");
+	ReflectionList *refls = _xtal->reflections();
+	_lookupDirty = false;
+
+	if (!refls->size())
+	{
+		_lookupGrid.clear();
+		return;
+	}
 
-	if (!onImage) return false;
+	_lookupGrid.build(&refls->posX[0], &refls->posY[0], &refls->flags[0],
+	                  ReflectionOnImage, refls->size(), CLOSENESS);
+}
 
-	vec3 pos = _xtal->position(i);
+const DetectorPanel &Detector::panelAtPixel(double x, double y)
+{
+	if (_panels.empty())
+	{
+		return _flatPanel;
+	}
 
-	if (x >= pos.x - CLOSENESS && x <= pos.x + CLOSENESS &&
-	    y >= pos.y - CLOSENESS && y <= pos.y + CLOSENESS)
+	for (size_t i = 0; i < _panels.size(); i++)
 	{
-		return true;
+		DetectorPanel &panel = _panels[i];
+
+		if (panel.width > 0 && panel.height > 0 &&
+		    panel_contains(panel, x - panel.imageX, y - panel.imageY))
+		{
+			return panel;
+		}
 	}
-	
-	return false;
+
+	return _panels[0];
 }
 
-int Detector::positionNearCoord(int x, int y)
+vec3 Detector::pixelDirection(double x, double y)
 {
-	x -= _beamCentre.x;
-	y -= _beamCentre.y;
+	const DetectorPanel &panel = panelAtPixel(x, y);
+	vec3 pos = vec3_add_vec3(panel.corner, panel_frame_origin(_beamCentre));
+	double u = x - panel.imageX;
+	double v = y - panel.imageY;
+
+	pos.x += panel.fast.x * u + panel.slow.x * v;
+	pos.y += panel.fast.y * u + panel.slow.y * v;
+	pos.z += panel.fast.z * u + panel.slow.z * v;
 
-	if (!_lookupTree)
+	return pos;
+}
+
+int Detector::observeSpots(std::vector<vec2> &spots)
+{
+	calculatePositions();
+	int count = 0;
+
+	for (size_t i = 0; i < spots.size(); i++)
 	{
-		for (size_t i = 0; i < _xtal->millerCount(); i++)
+		int num = positionNearCoord(lrint(spots[i].x), lrint(spots[i].y));
+
+		/* The first spot to claim a reflection keeps it */
+		if (num < 0 || _xtal->isBeingWatched(num))
 		{
-			if (nearMiller(i, x, y))
-			{
-				return i;
-			}
+			continue;
 		}
 
-		return -1;
+		_xtal->toggleWatched(num);
+		_xtal->setObservedPosition(num, spots[i].x, spots[i].y);
+		count++;
 	}
-	
-	Node *node = _lookupTree;
-	int drills = 0;
-	
-	/* Some non-exit condition and I'm too lazy to fix properly */
-	int max_drills = 50;
-
-	while (true && drills < max_drills)
+
+	return count;
+}
+
+void Detector::setSharedWavelength(void *object, double wavelength)
+{
+	Detector *detector = static_cast<Detector *>(object);
+	detector->_wavelength = wavelength;
+	detector->_xtal->setWavelength(wavelength);
+}
+
+void Detector::geometryResiduals(std::vector<double> *residuals)
+{
+	_xtal->recheckWatched();
+
+	ReflectionList *refls = _xtal->reflections();
+	std::vector<int> &watched = _xtal->watchedReflections();
+	double invRlpSize = 1 / _xtal->getRlpSize();
+	vec3 samplePos = make_vec3(0, 0, - 1 / _wavelength);
+	vec3 frame = panel_frame_origin(_beamCentre);
+
+	residuals->clear();
+
+	for (size_t j = 0; j < watched.size(); j++)
 	{
-		for (int i = 0; i < 4; i++)
-		{
-			Node *trial = node->nextNodes[i];
-
-			if (!trial)
-			{
-				goto finished_node_search;
-			}	
-
-			if (x > trial->xMin && x < trial->xMax && 
-			    y > trial->yMin && y < trial->yMax)
-			{
-				node = trial;
-				break;
-			}
-		}
-		
-		drills++;
+		residuals->push_back(refls->excitation[watched[j]] * invRlpSize);
 	}
-	
-finished_node_search:
-	
-	std::cout << "Drilled down " << drills << " nodes." << std::endl;
-	
-	int best_n = -1;
-	double distance = FLT_MAX;
-	
-	for (size_t i = 0; i < node->nRefls; i++)
+
+	for (size_t j = 0; j < watched.size(); j++)
 	{
-		int n = node->reflPtrs[i];
+		int i = watched[j];
 
-		if (nearMiller(n, x, y))
+		if (!(refls->flags[i] & ReflectionObserved))
 		{
-			double thisDist = distToMiller(n, x, y);
-			
-			if (thisDist < distance)
-			{
-				distance = thisDist;
-				best_n = n;	
-			}
+			continue;
 		}
+
+		/* Measured against the plane of the panel the spot was seen on,
+		 * so that each residual stays smooth as the prediction moves */
+		const DetectorPanel &panel = panelAtPixel(refls->obsX[i],
+		                                          refls->obsY[i]);
+		vec3 miller = _xtal->miller(i);
+		vec3 diff = vec3_subtract_vec3(miller, samplePos);
+		double u, v;
+		panel_intersect(panel, frame, diff, &u, &v);
+
+		residuals->push_back(panel.imageX + u - refls->obsX[i]);
+		residuals->push_back(panel.imageY + v - refls->obsY[i]);
 	}
-	
-	return best_n;
 }
 
-void Detector::prepareLookupTable()
+void Detector::geometryDerivatives(GeometryParameter param,
+                                   std::vector<double> *column)
 {
-	delete_node(_lookupTree);
-	_lookupTree = NULL;
-	
-	size_t count = _xtal->millerCount();
-	if (!count) return;
-
-	Reflection *start = _xtal->refl(0);
-	_lookupTree = make_node();
-	prepare_node(_lookupTree, start, count);
-	recursive_split_node(_lookupTree);
-}
+	ReflectionList *refls = _xtal->reflections();
+	std::vector<int> &watched = _xtal->watchedReflections();
+	double invRlpSize = 1 / _xtal->getRlpSize();
+	double invWavelengthSq = 1 / (_wavelength * _wavelength);
+	vec3 samplePos = make_vec3(0, 0, - 1 / _wavelength);
+	vec3 frame = panel_frame_origin(_beamCentre);
+	vec3 frameMove = empty_vec3();
+	std::vector<vec3> moves(watched.size(), empty_vec3());
 
-Detector::~Detector()
-{
-	if (_lookupTree)
+	/* The beam centre moves the detector the other way */
+	if (param == GeometryBeamX)
 	{
-		delete_node(_lookupTree);
+		frameMove.x = -1;
 	}
-}
+	else if (param == GeometryBeamY)
+	{
+		frameMove.y = -1;
+	}
+	else if (param == GeometryDistance)
+	{
+		frameMove.z = 1;
+	}
+
+	/* How far each reciprocal lattice point moves relative to the sample,
+	 * per unit of the parameter. Changing the wavelength moves the
+	 * sample rather than the lattice point, by -d(1/lambda) in z. */
+	for (size_t j = 0; j < watched.size(); j++)
+	{
+		vec3 dHoriz, dVert, dTwist;
+
+		switch (param)
+		{
+			case GeometryHorizontal:
+			case GeometryVertical:
+			case GeometryTwist:
+			_xtal->rotationDerivatives(watched[j], &dHoriz, &dVert, &dTwist);
+			moves[j] = (param == GeometryHorizontal ? dHoriz :
+			            (param == GeometryVertical ? dVert : dTwist));
+			break;
 
+			case GeometryWavelength:
+			moves[j] = make_vec3(0, 0, -invWavelengthSq);
+			break;
+
+			default:
+			break;
+		}
+	}
+
+	column->clear();
+
+	for (size_t j = 0; j < watched.size(); j++)
+	{
+		/* Excitation error is |q - s| - 1/lambda */
+		vec3 miller = _xtal->miller(watched[j]);
+		vec3 diff = vec3_subtract_vec3(miller, samplePos);
+		double derivative = vec3_dot_vec3(diff, moves[j]) / vec3_length(diff);
+
+		if (param == GeometryWavelength)
+		{
+			derivative += invWavelengthSq;
+		}
+
+		column->push_back(derivative * invRlpSize);
+	}
+
+	for (size_t j = 0; j < watched.size(); j++)
+	{
+		int i = watched[j];
+
+		if (!(refls->flags[i] & ReflectionObserved))
+		{
+			continue;
+		}
+
+		/* Position is where q - s meets the plane of the panel */
+		const DetectorPanel &panel = panelAtPixel(refls->obsX[i],
+		                                          refls->obsY[i]);
+		vec3 miller = _xtal->miller(i);
+		vec3 diff = vec3_subtract_vec3(miller, samplePos);
+		double dx, dy;
+		panel_intersect_derivative(panel, frame, diff, moves[j], frameMove,
+		                           &dx, &dy);
+
+		column->push_back(dx);
+		column->push_back(dy);
+	}
+}
@@ -20,17 +20,30 @@
 #define __Windexing__Detector__
 
 #include "mat3x3.h"
+#include "DetectorPanel.h"
 #include <vector>
 #include <iostream>
-#include "Node.h"
+#include "LookupGrid.h"
+#include "Trace.h"
 
 class Crystal;
 
+/* Parameters for which analytic derivatives of the residuals exist */
+typedef enum
+{
+	GeometryHorizontal,
+	GeometryVertical,
+	GeometryTwist,
+	GeometryWavelength,
+	GeometryBeamX,
+	GeometryBeamY,
+	GeometryDistance,
+} GeometryParameter;
+
 class Detector
 {
 public:
     Detector();
-	~Detector();
     
     void calculatePositions();
     int positionNearCoord(int x, int y);
@@ -60,30 +73,154 @@ public:
     void setWavelength(double wavelength)
     {
         _wavelength = wavelength;
-	std::cout << "Setting wavelength to " << wavelength << std::endl;
+	TRACE_LOG(TraceInfo, "Setting wavelength to " << wavelength);
     }
     
     void adjustBeamCentre(double x, double y)
     {
         _beamCentre.x += x;
         _beamCentre.y += y;
-        std::cout << "New beam centre " << _beamCentre.x << " "
-         << _beamCentre.y << std::endl;
+        TRACE_LOG(TraceInfo, "New beam centre " << _beamCentre.x << " "
+                  << _beamCentre.y);
     }
 
 	void setCrystal(Crystal *pointer)
 	{
 		_xtal = pointer;
 	}
+
+	/* With no panels the detector is one flat plane perpendicular to the
+	 * beam. Panels may be tilted and have gaps between them, and are
+	 * placed by the beam centre and distance as a whole. */
+	void addPanel(const DetectorPanel &panel)
+	{
+		_panels.push_back(panel);
+	}
+
+	void clearPanels()
+	{
+		_panels.clear();
+	}
+
+	size_t panelCount()
+	{
+		return _panels.size();
+	}
+
+	const DetectorPanel &getPanel(int i)
+	{
+		return _panels[i];
+	}
+
+	/* Panel which shows the given image pixel, or the first one if it
+	 * falls in a gap */
+	const DetectorPanel &panelAtPixel(double x, double y);
+
+	/* Direction from the sample to the given image pixel, in pixels */
+	vec3 pixelDirection(double x, double y);
+
+	/* Watches each reflection predicted within CLOSENESS pixels of one
+	 * of the spots, given in image pixels, and takes the spot as its
+	 * observed position. Returns the number of reflections matched. */
+	int observeSpots(std::vector<vec2> &spots);
+
+	/* Residuals for least-squares refinement of the watched reflections:
+	 * first each excitation error in rlp sizes, then the x and y errors in
+	 * pixels of each watched reflection with an observed position. */
+	void geometryResiduals(std::vector<double> *residuals);
+
+	/* Derivative of each residual above. Relies on the reflections having
+	 * been moved by the last call to geometryResiduals. */
+	void geometryDerivatives(GeometryParameter param,
+	                         std::vector<double> *column);
+
+	static void residuals(void *detector, std::vector<double> *residuals)
+	{
+		static_cast<Detector *>(detector)->geometryResiduals(residuals);
+	}
+
+	static void horizontalDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryHorizontal, column);
+	}
+
+	static void verticalDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryVertical, column);
+	}
+
+	static void twistDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryTwist, column);
+	}
+
+	static void wavelengthDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryWavelength, column);
+	}
+
+	static void beamXDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryBeamX, column);
+	}
+
+	static void beamYDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryBeamY, column);
+	}
+
+	static void distanceDerivatives(void *detector, std::vector<double> *column)
+	{
+		static_cast<Detector *>(detector)->geometryDerivatives(GeometryDistance, column);
+	}
+
+	static double getBeamX(void *detector)
+	{
+		return static_cast<Detector *>(detector)->_beamCentre.x;
+	}
+
+	static void setBeamX(void *detector, double x)
+	{
+		static_cast<Detector *>(detector)->_beamCentre.x = x;
+	}
+
+	static double getBeamY(void *detector)
+	{
+		return static_cast<Detector *>(detector)->_beamCentre.y;
+	}
+
+	static void setBeamY(void *detector, double y)
+	{
+		static_cast<Detector *>(detector)->_beamCentre.y = y;
+	}
+
+	static double getDistance(void *detector)
+	{
+		return static_cast<Detector *>(detector)->_beamCentre.z;
+	}
+
+	static void setDistance(void *detector, double z)
+	{
+		static_cast<Detector *>(detector)->_beamCentre.z = z;
+	}
+
+	/* Wavelength of both the detector and its crystal */
+	static double getSharedWavelength(void *detector)
+	{
+		return static_cast<Detector *>(detector)->_wavelength;
+	}
+
+	static void setSharedWavelength(void *detector, double wavelength);
 private:
 	Crystal *_xtal;
 	vec3 _beamCentre; // beam X, beam Y, det dist. all pix
+	std::vector<DetectorPanel> _panels;
+	DetectorPanel _flatPanel;
 	double _wavelength;
-	std::vector<vec3> _positions;
-	bool nearMiller(int i, int x, int y);
-	double distToMiller(int i, int x, int y);
 
-	Node *_lookupTree;
+	/* Rebuilt on demand after positions have changed */
+	LookupGrid _lookupGrid;
+	bool _lookupDirty;
 };
 
 
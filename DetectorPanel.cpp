@@ -0,0 +1,327 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "DetectorPanel.h"
+#include <limits>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <sstream>
+#include <stdlib.h>
+
+DetectorPanel make_flat_panel()
+{
+	DetectorPanel panel;
+	panel.corner = empty_vec3();
+	panel.fast = make_vec3(1, 0, 0);
+	panel.slow = make_vec3(0, 1, 0);
+	panel.width = 0;
+	panel.height = 0;
+	panel.imageX = 0;
+	panel.imageY = 0;
+
+	return panel;
+}
+
+DetectorPanel panel_from_string(std::vector<std::string> &components)
+{
+	double values[13];
+
+	for (int i = 0; i < 13; i++)
+	{
+		values[i] = atof(components[i + 1].c_str());
+	}
+
+	DetectorPanel panel;
+	panel.corner = make_vec3(values[0], values[1], values[2]);
+	panel.fast = make_vec3(values[3], values[4], values[5]);
+	panel.slow = make_vec3(values[6], values[7], values[8]);
+	vec3_set_length(&panel.fast, 1);
+	vec3_set_length(&panel.slow, 1);
+	panel.width = values[9];
+	panel.height = values[10];
+	panel.imageX = values[11];
+	panel.imageY = values[12];
+
+	return panel;
+}
+
+std::string computer_friendly_desc(const DetectorPanel &panel)
+{
+	std::ostringstream str;
+	str << panel.corner.x << " " << panel.corner.y << " " << panel.corner.z
+	<< " " << panel.fast.x << " " << panel.fast.y << " " << panel.fast.z
+	<< " " << panel.slow.x << " " << panel.slow.y << " " << panel.slow.z
+	<< " " << panel.width << " " << panel.height
+	<< " " << panel.imageX << " " << panel.imageY << std::endl;
+
+	return str.str();
+}
+
+#define PANEL_MAP_CELL 32
+#define PANEL_MAP_MARGIN 1
+#define PANEL_MAP_NONE -1
+#define PANEL_MAP_SHARED -2
+
+/* A panel with everything the projection needs, in the lab frame */
+template <typename T>
+struct PanelKernel
+{
+	T ox, oy, oz;
+	T nx, ny, nz;
+	T fx, fy, fz;
+	T sx, sy, sz;
+	T along;
+	T minU, maxU, minV, maxV;
+	T offsetX, offsetY;
+};
+
+template <typename T>
+static PanelKernel<T> make_panel_kernel(const DetectorPanel &panel,
+                                        const vec3 &beamCentre)
+{
+	const T infinity = std::numeric_limits<T>::infinity();
+	vec3 origin = vec3_add_vec3(panel.corner, panel_frame_origin(beamCentre));
+	vec3 normal = vec3_cross_vec3(panel.fast, panel.slow);
+
+	PanelKernel<T> k;
+	k.ox = origin.x; k.oy = origin.y; k.oz = origin.z;
+	k.nx = normal.x; k.ny = normal.y; k.nz = normal.z;
+	k.fx = panel.fast.x; k.fy = panel.fast.y; k.fz = panel.fast.z;
+	k.sx = panel.slow.x; k.sy = panel.slow.y; k.sz = panel.slow.z;
+	k.along = vec3_dot_vec3(origin, normal);
+	k.minU = (panel.width > 0 ? 0 : -infinity);
+	k.maxU = (panel.width > 0 ? panel.width : infinity);
+	k.minV = (panel.height > 0 ? 0 : -infinity);
+	k.maxV = (panel.height > 0 ? panel.height : infinity);
+	k.offsetX = panel.imageX - beamCentre.x;
+	k.offsetY = panel.imageY - beamCentre.y;
+
+	return k;
+}
+
+template <typename T>
+static inline bool panel_kernel_hit(const PanelKernel<T> &k,
+                                    T dx, T dy, T dz, T *x, T *y, T *z)
+{
+	T t = k.along / (dx * k.nx + dy * k.ny + dz * k.nz);
+	T hx = dx * t - k.ox;
+	T hy = dy * t - k.oy;
+	T hz = dz * t - k.oz;
+	T u = hx * k.fx + hy * k.fy + hz * k.fz;
+	T v = hx * k.sx + hy * k.sy + hz * k.sz;
+
+	*x = u + k.offsetX;
+	*y = v + k.offsetY;
+	*z = dz * t;
+
+	return (t > 0 && u >= k.minU && u < k.maxU && v >= k.minV && v < k.maxV);
+}
+
+/* Coarse map of the image as it would be on an untilted detector at the
+ * same distance. Each cell holds the only panel whose footprint covers
+ * it, PANEL_MAP_NONE if no panel can be seen through it or
+ * PANEL_MAP_SHARED if more than one might be. */
+typedef struct
+{
+	std::vector<short> cells;
+	int width;
+	int height;
+	double minX;
+	double minY;
+} PanelMap;
+
+static bool build_panel_map(const DetectorPanel *panels, size_t panelCount,
+                            const vec3 &beamCentre, PanelMap *map)
+{
+	vec3 frame = panel_frame_origin(beamCentre);
+	std::vector<double> bounds(panelCount * 4);
+	double minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+	/* A flat panel projects to a quadrilateral, which lies within the
+	 * box around its projected corners if all are in front of the
+	 * sample */
+	for (size_t p = 0; p < panelCount; p++)
+	{
+		const DetectorPanel &panel = panels[p];
+
+		if (panel.width <= 0 || panel.height <= 0 || beamCentre.z <= 0)
+		{
+			return false;
+		}
+
+		double *box = &bounds[p * 4];
+		box[0] = box[1] = FLT_MAX;
+		box[2] = box[3] = -FLT_MAX;
+
+		for (int c = 0; c < 4; c++)
+		{
+			double u = (c % 2) * panel.width;
+			double v = (c / 2) * panel.height;
+			vec3 pos = vec3_add_vec3(panel.corner, frame);
+			pos.x += panel.fast.x * u + panel.slow.x * v;
+			pos.y += panel.fast.y * u + panel.slow.y * v;
+			pos.z += panel.fast.z * u + panel.slow.z * v;
+
+			if (pos.z <= 0)
+			{
+				return false;
+			}
+
+			double x = pos.x * beamCentre.z / pos.z + beamCentre.x;
+			double y = pos.y * beamCentre.z / pos.z + beamCentre.y;
+			box[0] = std::min(box[0], x - PANEL_MAP_MARGIN);
+			box[1] = std::min(box[1], y - PANEL_MAP_MARGIN);
+			box[2] = std::max(box[2], x + PANEL_MAP_MARGIN);
+			box[3] = std::max(box[3], y + PANEL_MAP_MARGIN);
+		}
+
+		minX = std::min(minX, box[0]);
+		minY = std::min(minY, box[1]);
+		maxX = std::max(maxX, box[2]);
+		maxY = std::max(maxY, box[3]);
+	}
+
+	map->minX = minX;
+	map->minY = minY;
+	map->width = (int)((maxX - minX) / PANEL_MAP_CELL) + 1;
+	map->height = (int)((maxY - minY) / PANEL_MAP_CELL) + 1;
+	map->cells.assign((size_t)map->width * map->height, PANEL_MAP_NONE);
+
+	for (size_t p = 0; p < panelCount; p++)
+	{
+		double *box = &bounds[p * 4];
+		int x0 = (box[0] - minX) / PANEL_MAP_CELL;
+		int y0 = (box[1] - minY) / PANEL_MAP_CELL;
+		int x1 = (box[2] - minX) / PANEL_MAP_CELL;
+		int y1 = (box[3] - minY) / PANEL_MAP_CELL;
+
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				short &cell = map->cells[(size_t)y * map->width + x];
+				cell = (cell == PANEL_MAP_NONE ? (short)p : PANEL_MAP_SHARED);
+			}
+		}
+	}
+
+	return true;
+}
+
+template <typename T>
+void panel_project_vecs(const double *x, const double *y, const double *z,
+                        size_t count, const vec3 &samplePos,
+                        const vec3 &beamCentre,
+                        const DetectorPanel *panels, size_t panelCount,
+                        unsigned char *flags, unsigned char mask,
+                        double *outX, double *outY, double *outZ,
+                        short *outPanel)
+{
+	const T px = samplePos.x;
+	const T py = samplePos.y;
+	const T pz = samplePos.z;
+	const T dist = beamCentre.z;
+	const T bx = beamCentre.x;
+	const T by = beamCentre.y;
+	std::vector<PanelKernel<T> > kernels(panelCount);
+
+	for (size_t p = 0; p < panelCount; p++)
+	{
+		kernels[p] = make_panel_kernel<T>(panels[p], beamCentre);
+	}
+
+	/* Without a map, for instance with a panel of no size, every panel
+	 * is tried for every point */
+	PanelMap map;
+	bool mapped = build_panel_map(panels, panelCount, beamCentre, &map);
+	const T minX = (mapped ? map.minX : 0);
+	const T minY = (mapped ? map.minY : 0);
+	const T invCell = (T)1 / PANEL_MAP_CELL;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!(flags[i] & mask))
+		{
+			continue;
+		}
+
+		T dx = (T)x[i] - px;
+		T dy = (T)y[i] - py;
+		T dz = (T)z[i] - pz;
+		T hx, hy, hz;
+		short candidate = PANEL_MAP_SHARED;
+		short found = -1;
+
+		if (mapped)
+		{
+			/* Points in cells which no panel covers go straight away */
+			T mult = dist / dz;
+			int cx = (int)floor((dx * mult + bx - minX) * invCell);
+			int cy = (int)floor((dy * mult + by - minY) * invCell);
+			bool inside = (dz > 0 && cx >= 0 && cx < map.width &&
+			               cy >= 0 && cy < map.height);
+			candidate = (inside ? map.cells[(size_t)cy * map.width + cx]
+			             : PANEL_MAP_NONE);
+		}
+
+		if (candidate >= 0)
+		{
+			if (panel_kernel_hit(kernels[candidate], dx, dy, dz,
+			                     &hx, &hy, &hz))
+			{
+				found = candidate;
+			}
+		}
+		else if (candidate == PANEL_MAP_SHARED)
+		{
+			for (size_t p = 0; p < panelCount; p++)
+			{
+				if (panel_kernel_hit(kernels[p], dx, dy, dz, &hx, &hy, &hz))
+				{
+					found = p;
+					break;
+				}
+			}
+		}
+
+		outPanel[i] = found;
+
+		if (found < 0)
+		{
+			flags[i] &= ~mask;
+			continue;
+		}
+
+		outX[i] = hx;
+		outY[i] = hy;
+		outZ[i] = hz;
+	}
+}
+
+template void panel_project_vecs<float>(const double *, const double *,
+                                        const double *, size_t, const vec3 &,
+                                        const vec3 &, const DetectorPanel *,
+                                        size_t, unsigned char *, unsigned char,
+                                        double *, double *, double *, short *);
+template void panel_project_vecs<double>(const double *, const double *,
+                                         const double *, size_t, const vec3 &,
+                                         const vec3 &, const DetectorPanel *,
+                                         size_t, unsigned char *, unsigned char,
+                                         double *, double *, double *, short *);
@@ -0,0 +1,125 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__DetectorPanel__
+#define __Windexing__DetectorPanel__
+
+#include "vec3.h"
+#include <vector>
+#include <string>
+
+/* One flat module of a detector, in pixels. Positions are given in the
+ * detector frame, which is the plane of a single untilted detector: its
+ * origin is pixel (0, 0) of the image, x and y run along the image rows
+ * and columns and z runs along the beam. The beam centre and distance
+ * place this frame relative to the sample. */
+typedef struct
+{
+	vec3 corner; // pixel (0, 0) of the panel in the detector frame
+	vec3 fast; // unit vector along a row of the panel
+	vec3 slow; // unit vector along a column of the panel
+	double width;
+	double height; // extent along fast and slow; zero for no edge
+	double imageX;
+	double imageY; // where pixel (0, 0) of the panel sits in the image
+} DetectorPanel;
+
+/* The whole detector frame as one unbounded panel, which projects in the
+ * same way as a detector without panels */
+DetectorPanel make_flat_panel();
+
+/* Expects "panel", then the corner, fast and slow axes as three values
+ * each, then width, height, image x and image y. The axes are
+ * normalised. */
+DetectorPanel panel_from_string(std::vector<std::string> &components);
+std::string computer_friendly_desc(const DetectorPanel &panel);
+
+/* Lab position of the detector frame origin relative to the sample, for
+ * a beam centre of (x, y) and a distance of z, all in pixels */
+inline constexpr vec3 panel_frame_origin(const vec3 &beamCentre)
+{
+	return make_vec3(-beamCentre.x, -beamCentre.y, beamCentre.z);
+}
+
+/* Intersects the ray from the sample along diff with the plane of the
+ * panel. Returns the multiple of diff at which they meet, negative if
+ * the panel is behind the sample, and sets u and v to the position
+ * along the fast and slow axes. Bounds are not checked. */
+inline double panel_intersect(const DetectorPanel &panel, const vec3 &frame,
+                              const vec3 &diff, double *u, double *v)
+{
+	vec3 origin = vec3_add_vec3(panel.corner, frame);
+	vec3 normal = vec3_cross_vec3(panel.fast, panel.slow);
+	double t = vec3_dot_vec3(origin, normal) / vec3_dot_vec3(diff, normal);
+	vec3 hit = make_vec3(diff.x * t - origin.x, diff.y * t - origin.y,
+	                     diff.z * t - origin.z);
+
+	*u = vec3_dot_vec3(hit, panel.fast);
+	*v = vec3_dot_vec3(hit, panel.slow);
+
+	return t;
+}
+
+/* Rate of change of u and v above when diff moves by move and the
+ * detector frame by frameMove, per unit of some parameter */
+inline void panel_intersect_derivative(const DetectorPanel &panel,
+                                       const vec3 &frame, const vec3 &diff,
+                                       const vec3 &move, const vec3 &frameMove,
+                                       double *du, double *dv)
+{
+	vec3 origin = vec3_add_vec3(panel.corner, frame);
+	vec3 normal = vec3_cross_vec3(panel.fast, panel.slow);
+	double dn = vec3_dot_vec3(diff, normal);
+	double t = vec3_dot_vec3(origin, normal) / dn;
+	double dt = (vec3_dot_vec3(frameMove, normal)
+	             - t * vec3_dot_vec3(move, normal)) / dn;
+	vec3 dHit = make_vec3(diff.x * dt + move.x * t - frameMove.x,
+	                      diff.y * dt + move.y * t - frameMove.y,
+	                      diff.z * dt + move.z * t - frameMove.z);
+
+	*du = vec3_dot_vec3(dHit, panel.fast);
+	*dv = vec3_dot_vec3(dHit, panel.slow);
+}
+
+inline bool panel_contains(const DetectorPanel &panel, double u, double v)
+{
+	return ((panel.width <= 0 || (u >= 0 && u < panel.width)) &&
+	        (panel.height <= 0 || (v >= 0 && v < panel.height)));
+}
+
+/* Batched ray-plane projection of count points, held as separate
+ * coordinate arrays, onto a set of panels. Each point whose flags share
+ * a bit with the mask is assigned the panel it lands on, and its image
+ * position less the beam centre goes to outX and outY, as from
+ * vec3_project_vecs. A coarse map of where the panels appear in the
+ * image leaves one panel to try for most points, and points which can
+ * only fall between panels are culled before any intersection is
+ * worked out. Culled points lose the mask bits and get a panel of -1,
+ * so that they are left out of drawing and picking without any further
+ * checks. The arithmetic is done in T. */
+template <typename T = double>
+void panel_project_vecs(const double *x, const double *y, const double *z,
+                        size_t count, const vec3 &samplePos,
+                        const vec3 &beamCentre,
+                        const DetectorPanel *panels, size_t panelCount,
+                        unsigned char *flags, unsigned char mask,
+                        double *outX, double *outY, double *outZ,
+                        short *outPanel);
+
+#endif
@@ -42,6 +42,7 @@ typedef enum
     DialogueWavelength,
     DialogueRlpSize,
     DialogueDegreeStep,
+    DialogueSeries,
 } DialogueType;
 
 class Dialogue : public QMainWindow
@@ -73,10 +73,16 @@ public:
 			return filename;
 		}
 
-		std::string fullPath = "./" + outputDir + "/" + filename;
+		/* Relative directories are taken from the working directory */
+		std::string fullPath = outputDir + "/" + filename;
 		return fullPath;
 	}
 
+	inline static bool hasOutputDirectory()
+	{
+		return (outputDir.length() > 0);
+	}
+
 private:
 	static std::string outputDir;
 
@@ -0,0 +1,102 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "FrameReader.h"
+#include "MappedFile.h"
+#include "ImageFrame.h"
+#include "RawFrameReader.h"
+#include "CBFFrameReader.h"
+
+std::vector<FrameReaderPtr> &FrameReader::readers()
+{
+	static std::vector<FrameReaderPtr> list;
+
+	if (list.size() == 0)
+	{
+		list.push_back(FrameReaderPtr(new RawFrameReader()));
+		list.push_back(FrameReaderPtr(new CBFFrameReader()));
+	}
+
+	return list;
+}
+
+void FrameReader::addReader(FrameReaderPtr reader)
+{
+	readers().push_back(reader);
+}
+
+bool FrameReader::isFrameFile(std::string filename)
+{
+	MappedFilePtr file = MappedFilePtr(new MappedFile(filename));
+
+	if (!file->isValid())
+	{
+		return false;
+	}
+
+	std::vector<FrameReaderPtr> &list = readers();
+
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		if (list[i]->canRead(file))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+ImageFramePtr FrameReader::readFrame(std::string filename,
+                                     std::string *error)
+{
+	MappedFilePtr file = MappedFilePtr(new MappedFile(filename));
+	std::string message = "Could not open " + filename + ".";
+
+	if (file->isValid())
+	{
+		message = "No reader recognises " + filename + ".";
+		std::vector<FrameReaderPtr> &list = readers();
+
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			if (!list[i]->canRead(file))
+			{
+				continue;
+			}
+
+			ImageFramePtr frame = list[i]->read(file);
+
+			if (frame)
+			{
+				return frame;
+			}
+
+			message = list[i]->getError();
+			break;
+		}
+	}
+
+	if (error != NULL)
+	{
+		*error = message;
+	}
+
+	return ImageFramePtr();
+}
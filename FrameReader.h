@@ -0,0 +1,61 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__FrameReader__
+#define __Windexing__FrameReader__
+
+#include <string>
+#include <vector>
+#include "shared_ptrs.h"
+
+/* Decodes one native detector format from a mapped file. Readers are
+ * tried in the order they were added until one recognises the file. */
+
+class FrameReader
+{
+public:
+	virtual ~FrameReader() {};
+
+	/* Whether the file looks like this reader's format */
+	virtual bool canRead(MappedFilePtr file) = 0;
+
+	/* Returns an empty pointer and sets the error on failure */
+	virtual ImageFramePtr read(MappedFilePtr file) = 0;
+
+	std::string getError()
+	{
+		return _error;
+	}
+
+	static void addReader(FrameReaderPtr reader);
+
+	/* Whether any reader recognises the file, without decoding it */
+	static bool isFrameFile(std::string filename);
+
+	/* Maps and decodes the file with the first reader which recognises
+	 * it. Fills in the error on failure if given somewhere to put it. */
+	static ImageFramePtr readFrame(std::string filename,
+	                               std::string *error = NULL);
+protected:
+	std::string _error;
+private:
+	static std::vector<FrameReaderPtr> &readers();
+};
+
+#endif
@@ -0,0 +1,386 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "FrameSeries.h"
+#include "FrameReader.h"
+#include "ImageFrame.h"
+#include "ImagePyramid.h"
+#include "FileReader.h"
+#include "Trace.h"
+#include <algorithm>
+#include <stdlib.h>
+
+static const char *image_extensions[] = {"cbf", "raw", "png", "jpg",
+                                         "jpeg", "tif", "tiff", "bmp"};
+
+FrameSeries::FrameSeries()
+{
+	_index = 0;
+	_prefetch = DEFAULT_PREFETCH_COUNT;
+	_cacheSize = DEFAULT_CACHE_SIZE;
+	_decoder = &FrameSeries::defaultDecoder;
+	_decoderObject = NULL;
+	_stop = false;
+}
+
+FrameSeries::~FrameSeries()
+{
+	stopWorker();
+}
+
+void FrameSeries::stopWorker()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_wake.notify_all();
+
+	if (_worker.joinable())
+	{
+		_worker.join();
+	}
+
+	_stop = false;
+}
+
+bool FrameSeries::defaultDecoder(void *, std::string filename,
+                                 SeriesFrame *frame)
+{
+	frame->frame = FrameReader::readFrame(filename, &frame->error);
+
+	if (!frame->frame)
+	{
+		return false;
+	}
+
+	frame->pyramid = ImagePyramidPtr(new ImagePyramid(frame->frame));
+	return true;
+}
+
+static bool is_directory(std::string path)
+{
+	struct stat info;
+	return (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+}
+
+static std::vector<std::string> list_directory(std::string dir)
+{
+	std::vector<std::string> names;
+	DIR *handle = opendir(dir.c_str());
+
+	if (!handle)
+	{
+		return names;
+	}
+
+	struct dirent *entry;
+
+	while ((entry = readdir(handle)) != NULL)
+	{
+		if (entry->d_name[0] != '.')
+		{
+			names.push_back(entry->d_name);
+		}
+	}
+
+	closedir(handle);
+	std::sort(names.begin(), names.end());
+
+	return names;
+}
+
+bool FrameSeries::load(std::string path)
+{
+	stopWorker();
+	_filenames.clear();
+	_cache.clear();
+	_recent.clear();
+	_queue.clear();
+	_index = 0;
+
+	bool success;
+
+	if (path.find('#') != std::string::npos)
+	{
+		success = loadTemplate(path);
+	}
+	else
+	{
+		success = loadDirectory(path);
+	}
+
+	if (success && !_filenames.size())
+	{
+		_error = "No frames found for " + path + ".";
+		success = false;
+	}
+
+	if (success)
+	{
+		_worker = std::thread(&FrameSeries::prefetchLoop, this);
+	}
+
+	return success;
+}
+
+bool FrameSeries::loadDirectory(std::string dir)
+{
+	if (!is_directory(dir))
+	{
+		_error = dir + " is not a directory.";
+		return false;
+	}
+
+	std::vector<std::string> names = list_directory(dir);
+	size_t count = sizeof(image_extensions) / sizeof(image_extensions[0]);
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		size_t dot = names[i].rfind('.');
+
+		if (dot == std::string::npos)
+		{
+			continue;
+		}
+
+		std::string extension = names[i].substr(dot + 1);
+		to_lower(extension);
+
+		for (size_t j = 0; j < count; j++)
+		{
+			if (extension == image_extensions[j])
+			{
+				_filenames.push_back(dir + "/" + names[i]);
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool FrameSeries::loadTemplate(std::string pattern)
+{
+	std::string dir = ".";
+	size_t slash = pattern.rfind('/');
+
+	if (slash != std::string::npos)
+	{
+		dir = pattern.substr(0, slash);
+		pattern = pattern.substr(slash + 1);
+	}
+
+	size_t start = pattern.find('#');
+
+	if (start == std::string::npos)
+	{
+		_error = "The '#' characters must be in the file name.";
+		return false;
+	}
+
+	size_t end = pattern.find_first_not_of('#', start);
+	if (end == std::string::npos) end = pattern.length();
+
+	std::string prefix = pattern.substr(0, start);
+	std::string suffix = pattern.substr(end);
+	size_t digits = end - start;
+
+	std::vector<std::string> names = list_directory(dir);
+	std::vector<std::pair<long, std::string> > numbered;
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		std::string &name = names[i];
+
+		if (name.length() != prefix.length() + digits + suffix.length() ||
+		    name.compare(0, prefix.length(), prefix) != 0 ||
+		    name.compare(name.length() - suffix.length(),
+		                 suffix.length(), suffix) != 0)
+		{
+			continue;
+		}
+
+		std::string number = name.substr(prefix.length(), digits);
+
+		if (number.find_first_not_of("0123456789") != std::string::npos)
+		{
+			continue;
+		}
+
+		numbered.push_back(std::make_pair(atol(number.c_str()),
+		                                  dir + "/" + name));
+	}
+
+	std::sort(numbered.begin(), numbered.end());
+
+	for (size_t i = 0; i < numbered.size(); i++)
+	{
+		_filenames.push_back(numbered[i].second);
+	}
+
+	return true;
+}
+
+bool FrameSeries::decode(int index, SeriesFrame *frame)
+{
+	TRACE_SCOPE("FrameSeries::decode");
+	return (*_decoder)(_decoderObject, _filenames[index], frame);
+}
+
+/* Call with the mutex held */
+void FrameSeries::touch(int index)
+{
+	_recent.remove(index);
+	_recent.push_front(index);
+}
+
+/* Call with the mutex held */
+void FrameSeries::store(int index, SeriesFrame frame)
+{
+	_cache[index] = frame;
+	touch(index);
+
+	size_t limit = std::max(_cacheSize, _prefetch + 2);
+
+	while (_recent.size() > limit)
+	{
+		_cache.erase(_recent.back());
+		_recent.pop_back();
+	}
+}
+
+SeriesFrame FrameSeries::frame(int index)
+{
+	SeriesFrame result;
+
+	if (index < 0 || index >= (int)size())
+	{
+		return result;
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_index = index;
+
+	/* Ahead first, nearest first, then the one behind */
+	_queue.clear();
+
+	for (int i = 1; i <= _prefetch && index + i < (int)size(); i++)
+	{
+		_queue.push_back(index + i);
+	}
+
+	if (index > 0)
+	{
+		_queue.push_back(index - 1);
+	}
+
+	_queue.remove(index);
+	_wake.notify_all();
+
+	_decoded.wait(lock, [&]{ return !_decoding.count(index); });
+
+	std::map<int, SeriesFrame>::iterator it = _cache.find(index);
+
+	if (it != _cache.end())
+	{
+		touch(index);
+		return it->second;
+	}
+
+	_decoding.insert(index);
+	lock.unlock();
+
+	bool success = decode(index, &result);
+
+	lock.lock();
+	_decoding.erase(index);
+
+	if (success)
+	{
+		store(index, result);
+	}
+	else
+	{
+		_error = result.error;
+
+		if (!_error.length())
+		{
+			_error = "Could not decode " + _filenames[index] + ".";
+		}
+
+		result = SeriesFrame();
+		result.error = _error;
+	}
+
+	_decoded.notify_all();
+
+	return result;
+}
+
+void FrameSeries::prefetchLoop()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		_wake.wait(lock, [&]{ return _stop || _queue.size(); });
+
+		if (_stop)
+		{
+			return;
+		}
+
+		int index = _queue.front();
+		_queue.pop_front();
+
+		if (_cache.count(index) || _decoding.count(index))
+		{
+			if (_cache.count(index))
+			{
+				touch(index);
+			}
+
+			continue;
+		}
+
+		_decoding.insert(index);
+		lock.unlock();
+
+		SeriesFrame result;
+		bool success = decode(index, &result);
+
+		/* The display levels are built here too, ready for stepping */
+		if (success && result.pyramid)
+		{
+			result.pyramid->buildLevels();
+		}
+
+		lock.lock();
+		_decoding.erase(index);
+
+		if (success)
+		{
+			store(index, result);
+		}
+
+		_decoded.notify_all();
+	}
+}
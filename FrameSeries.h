@@ -0,0 +1,153 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__FrameSeries__
+#define __Windexing__FrameSeries__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "shared_ptrs.h"
+
+#define DEFAULT_PREFETCH_COUNT 4
+#define DEFAULT_CACHE_SIZE 12
+
+/* Decoded frame: counts if the format has them, and the display copy */
+typedef struct
+{
+	ImageFramePtr frame;
+	ImagePyramidPtr pyramid;
+	std::string error; // why the file could not be decoded, if it couldn't
+} SeriesFrame;
+
+/* Fills in the frame from the file, returning false if it cannot */
+typedef bool (*FrameDecoder)(void *object, std::string filename,
+                             SeriesFrame *frame);
+
+/* An ordered list of frames to step through. A background thread decodes
+ * the frames just ahead of (and one behind) the current one into a cache
+ * which keeps the most recently used frames. */
+
+class FrameSeries
+{
+public:
+	FrameSeries();
+	~FrameSeries();
+
+	/* A directory (every image in it, in name order) or a template in
+	 * which a run of '#' stands for the frame number, such as
+	 * "images/xtal_####.cbf" (matching frames in number order). */
+	bool load(std::string path);
+
+	std::string getError()
+	{
+		return _error;
+	}
+
+	/* Replaces FrameReader decoding, which cannot read other images. It
+	 * is called on the prefetch thread as well as the caller's. */
+	void setDecoder(FrameDecoder decoder, void *object)
+	{
+		_decoder = decoder;
+		_decoderObject = object;
+	}
+
+	void setPrefetchCount(int count)
+	{
+		_prefetch = count;
+	}
+
+	/* Frames kept decoded, at least one more than the prefetch count */
+	void setCacheSize(int size)
+	{
+		_cacheSize = size;
+	}
+
+	size_t size()
+	{
+		return _filenames.size();
+	}
+
+	int index()
+	{
+		return _index;
+	}
+
+	std::string filename(int index)
+	{
+		return _filenames[index];
+	}
+
+	/* Makes the frame current, decoding it now unless it is cached or
+	 * already being decoded, and queues the frames around it. The frame
+	 * pointers are empty if it could not be decoded. */
+	SeriesFrame frame(int index);
+
+	SeriesFrame next()
+	{
+		return frame(_index + 1 < (int)size() ? _index + 1 : _index);
+	}
+
+	SeriesFrame previous()
+	{
+		return frame(_index > 0 ? _index - 1 : 0);
+	}
+
+	static bool defaultDecoder(void *object, std::string filename,
+	                           SeriesFrame *frame);
+private:
+	FrameSeries(const FrameSeries &);
+	FrameSeries &operator=(const FrameSeries &);
+
+	bool loadDirectory(std::string dir);
+	bool loadTemplate(std::string pattern);
+	void stopWorker();
+	void prefetchLoop();
+	bool decode(int index, SeriesFrame *frame);
+	void store(int index, SeriesFrame frame);
+	void touch(int index);
+
+	std::vector<std::string> _filenames;
+	std::string _error;
+	int _index;
+	int _prefetch;
+	int _cacheSize;
+
+	FrameDecoder _decoder;
+	void *_decoderObject;
+
+	/* Guarded by _mutex */
+	std::map<int, SeriesFrame> _cache;
+	std::list<int> _recent;
+	std::list<int> _queue;
+	std::set<int> _decoding;
+	bool _stop;
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _decoded;
+	std::thread _worker;
+};
+
+#endif
@@ -15,22 +15,23 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 // 
 // Please email: vagabond @ hginn.co.uk for more details.
-#include "Crystal.h"
 
-typedef struct Node
+
+#include "ImageFrame.h"
+
+ImageFrame::ImageFrame(int width, int height)
 {
-	int xMin;
-	int xMax;
-	int yMin;
-	int yMax;
-	Reflection *start;
-	Node *nextNodes[4];
-	int *reflPtrs;
-	size_t nRefls;
-} Node;
+	_width = width;
+	_height = height;
+	_pixels.resize((size_t)width * height, 0);
+	_data = &_pixels[0];
+}
 
-Node *make_node();
-void prepare_node(Node *node, Reflection *refls, int nRefls);
-void recursive_split_node(Node *node);
-void split_node(Node *node);
-void delete_node(Node *node);
+ImageFrame::ImageFrame(int width, int height, int32_t *pixels,
+                       boost::shared_ptr<void> owner)
+{
+	_width = width;
+	_height = height;
+	_data = pixels;
+	_owner = owner;
+}
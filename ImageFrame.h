@@ -0,0 +1,73 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__ImageFrame__
+#define __Windexing__ImageFrame__
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "boost/shared_ptr.hpp"
+
+/* Detector image as 32-bit integer counts, row by row. Negative values
+ * mark pixels without data, such as the gaps between modules. */
+
+class ImageFrame
+{
+public:
+	ImageFrame(int width, int height);
+
+	/* Uses pixels which belong to another object, such as a mapped file,
+	 * without copying them. The owner is kept alive with the frame. */
+	ImageFrame(int width, int height, int32_t *pixels,
+	           boost::shared_ptr<void> owner);
+
+	int width()
+	{
+		return _width;
+	}
+
+	int height()
+	{
+		return _height;
+	}
+
+	int32_t *data()
+	{
+		return _data;
+	}
+
+	int32_t *row(int y)
+	{
+		return _data + (size_t)y * _width;
+	}
+
+	int32_t value(int x, int y)
+	{
+		return _data[(size_t)y * _width + x];
+	}
+private:
+	int _width;
+	int _height;
+	int32_t *_data;
+	std::vector<int32_t> _pixels;
+	boost::shared_ptr<void> _owner;
+};
+
+#endif
@@ -0,0 +1,160 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "ImagePyramid.h"
+#include "ImageFrame.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <algorithm>
+#include <string.h>
+
+#define DISPLAY_PERCENTILE 0.99
+#define DISPLAY_SAMPLES 100000
+
+ImagePyramid::ImagePyramid(ImageFramePtr frame)
+{
+	allocate(frame->width(), frame->height());
+
+	size_t count = (size_t)frame->width() * frame->height();
+	size_t stride = std::max<size_t>(count / DISPLAY_SAMPLES, 1);
+	std::vector<int32_t> sample;
+	const int32_t *data = frame->data();
+
+	for (size_t i = 0; i < count; i += stride)
+	{
+		if (data[i] >= 0)
+		{
+			sample.push_back(data[i]);
+		}
+	}
+
+	int32_t ceiling = 1;
+
+	if (sample.size())
+	{
+		size_t n = (size_t)(DISPLAY_PERCENTILE * (sample.size() - 1));
+		std::nth_element(sample.begin(), sample.begin() + n, sample.end());
+		ceiling = std::max(sample[n], 1);
+	}
+
+	unsigned char *grey = &_levels[0][0];
+
+	/* Dark spots on a light background, as on film */
+	for (size_t i = 0; i < count; i++)
+	{
+		int32_t value = std::min(std::max(data[i], 0), ceiling);
+		grey[i] = 255 - (unsigned char)((int64_t)value * 255 / ceiling);
+	}
+}
+
+ImagePyramid::ImagePyramid(int width, int height,
+                           const unsigned char *grey, size_t stride)
+{
+	allocate(width, height);
+
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(&_levels[0][(size_t)y * width], grey + y * stride, width);
+	}
+}
+
+void ImagePyramid::allocate(int width, int height)
+{
+	_ready = NULL;
+	_readyObject = NULL;
+	_cancel = false;
+	_readyLevels = 1;
+
+	while (true)
+	{
+		_widths.push_back(width);
+		_heights.push_back(height);
+		_levels.push_back(std::vector<unsigned char>((size_t)width * height));
+
+		if (width <= PYRAMID_TILE_SIZE && height <= PYRAMID_TILE_SIZE)
+		{
+			break;
+		}
+
+		width = std::max((width + 1) / 2, 1);
+		height = std::max((height + 1) / 2, 1);
+	}
+}
+
+ImagePyramid::~ImagePyramid()
+{
+	_cancel = true;
+
+	if (_worker.joinable())
+	{
+		_worker.join();
+	}
+}
+
+void ImagePyramid::build()
+{
+	if (!_worker.joinable() && readyLevels() < levelCount())
+	{
+		_worker = std::thread(&ImagePyramid::buildLevels, this);
+	}
+}
+
+/* Each level averages 2x2 blocks of the one above; odd edges repeat the
+ * last row or column. */
+void ImagePyramid::buildLevels()
+{
+	TRACE_SCOPE("ImagePyramid::buildLevels");
+	for (size_t l = readyLevels(); l < _levels.size() && !_cancel; l++)
+	{
+		const unsigned char *src = &_levels[l - 1][0];
+		unsigned char *dest = &_levels[l][0];
+		int sw = _widths[l - 1];
+		int sh = _heights[l - 1];
+		int dw = _widths[l];
+		int dh = _heights[l];
+
+		parallel_for(dh, 0, [&](size_t y, int)
+		{
+			const unsigned char *top = src + (size_t)(2 * y) * sw;
+			const unsigned char *bottom = top;
+
+			if ((int)(2 * y + 1) < sh)
+			{
+				bottom = top + sw;
+			}
+
+			unsigned char *row = dest + y * dw;
+
+			for (int x = 0; x < dw; x++)
+			{
+				int x0 = 2 * x;
+				int x1 = std::min(x0 + 1, sw - 1);
+				int sum = top[x0] + top[x1] + bottom[x0] + bottom[x1];
+				row[x] = (sum + 2) >> 2;
+			}
+		}, 16);
+
+		_readyLevels.store(l + 1, std::memory_order_release);
+
+		if (_ready)
+		{
+			(*_ready)(_readyObject);
+		}
+	}
+}
@@ -0,0 +1,114 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__ImagePyramid__
+#define __Windexing__ImagePyramid__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stddef.h>
+#include "shared_ptrs.h"
+
+#define PYRAMID_TILE_SIZE 256
+
+typedef void (*LevelReady)(void *);
+
+/* Grey display copy of an image at successively halved resolutions.
+ * Level 0 is ready on construction; build() makes the smaller levels on
+ * a background thread, calling the ready function (from that thread)
+ * after each one. Levels stop once they fit inside a single tile. */
+
+class ImagePyramid
+{
+public:
+	/* Detector counts are mapped to grey, saturating at a high
+	 * percentile; pixels without data are black. */
+	ImagePyramid(ImageFramePtr frame);
+
+	/* Copies eight-bit grey rows which are stride bytes apart */
+	ImagePyramid(int width, int height, const unsigned char *grey,
+	             size_t stride);
+	~ImagePyramid();
+
+	void setReadyFunction(LevelReady ready, void *object)
+	{
+		_ready = ready;
+		_readyObject = object;
+	}
+
+	/* Builds the remaining levels in the background */
+	void build();
+
+	/* Builds the remaining levels on the calling thread */
+	void buildLevels();
+
+	int width()
+	{
+		return _widths[0];
+	}
+
+	int height()
+	{
+		return _heights[0];
+	}
+
+	int levelCount()
+	{
+		return _levels.size();
+	}
+
+	/* Levels below this number may be read */
+	int readyLevels()
+	{
+		return _readyLevels.load(std::memory_order_acquire);
+	}
+
+	int levelWidth(int level)
+	{
+		return _widths[level];
+	}
+
+	int levelHeight(int level)
+	{
+		return _heights[level];
+	}
+
+	const unsigned char *level(int level)
+	{
+		return &_levels[level][0];
+	}
+private:
+	ImagePyramid(const ImagePyramid &);
+	ImagePyramid &operator=(const ImagePyramid &);
+
+	void allocate(int width, int height);
+
+	std::vector<std::vector<unsigned char> > _levels;
+	std::vector<int> _widths;
+	std::vector<int> _heights;
+	std::atomic<int> _readyLevels;
+	std::atomic<bool> _cancel;
+	std::thread _worker;
+
+	LevelReady _ready;
+	void *_readyObject;
+};
+
+#endif
@@ -0,0 +1,220 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "ImageView.h"
+#include "ImagePyramid.h"
+#include "Trace.h"
+#include <QtGui/qpainter.h>
+#include <QtGui/qimage.h>
+#include <QtCore/qmetaobject.h>
+#include <math.h>
+
+#define MAX_ZOOM 256.
+/* In kilobytes, as tiles are costed */
+#define TILE_CACHE_SIZE (128 * 1024)
+
+ImageView::ImageView(QWidget *parent) : QWidget(parent)
+{
+	_zoom = 1;
+	_centreX = 0;
+	_centreY = 0;
+	_tiles.setMaxCost(TILE_CACHE_SIZE);
+}
+
+void ImageView::setPyramid(ImagePyramidPtr pyramid)
+{
+	_tiles.clear();
+	_pyramid = pyramid;
+	_zoom = 1;
+
+	if (_pyramid)
+	{
+		_centreX = _pyramid->width() / 2.;
+		_centreY = _pyramid->height() / 2.;
+		_pyramid->setReadyFunction(&ImageView::levelReady, this);
+		_pyramid->build();
+	}
+
+	update();
+}
+
+/* Called from the pyramid's thread, so the repaint is queued */
+void ImageView::levelReady(void *object)
+{
+	ImageView *view = static_cast<ImageView *>(object);
+	QMetaObject::invokeMethod(view, "update", Qt::QueuedConnection);
+}
+
+double ImageView::fitScale()
+{
+	if (!_pyramid)
+	{
+		return 1;
+	}
+
+	double sx = width() / (double)_pyramid->width();
+	double sy = height() / (double)_pyramid->height();
+
+	return (sx < sy) ? sx : sy;
+}
+
+double ImageView::scale()
+{
+	return fitScale() * _zoom;
+}
+
+void ImageView::toImage(double *x, double *y)
+{
+	double s = scale();
+	*x = (*x - width() / 2.) / s + _centreX;
+	*y = (*y - height() / 2.) / s + _centreY;
+}
+
+void ImageView::toWidget(double *x, double *y)
+{
+	double s = scale();
+	*x = (*x - _centreX) * s + width() / 2.;
+	*y = (*y - _centreY) * s + height() / 2.;
+}
+
+void ImageView::zoomAt(double x, double y, double factor)
+{
+	double ix = x;
+	double iy = y;
+	toImage(&ix, &iy);
+
+	_zoom *= factor;
+	if (_zoom < 1) _zoom = 1;
+	if (_zoom > MAX_ZOOM) _zoom = MAX_ZOOM;
+
+	double s = scale();
+	_centreX = ix - (x - width() / 2.) / s;
+	_centreY = iy - (y - height() / 2.) / s;
+	clampCentre();
+	update();
+}
+
+void ImageView::pan(double dx, double dy)
+{
+	double s = scale();
+	_centreX -= dx / s;
+	_centreY -= dy / s;
+	clampCentre();
+	update();
+}
+
+/* Keeps the centre of the view over the image */
+void ImageView::clampCentre()
+{
+	if (!_pyramid)
+	{
+		return;
+	}
+
+	if (_centreX < 0) _centreX = 0;
+	if (_centreY < 0) _centreY = 0;
+	if (_centreX > _pyramid->width()) _centreX = _pyramid->width();
+	if (_centreY > _pyramid->height()) _centreY = _pyramid->height();
+}
+
+QPixmap *ImageView::tile(int level, int tx, int ty)
+{
+	quint64 key = ((quint64)level << 48) | ((quint64)ty << 24) | tx;
+	QPixmap *pixmap = _tiles.object(key);
+
+	if (pixmap)
+	{
+		return pixmap;
+	}
+
+	int lw = _pyramid->levelWidth(level);
+	int lh = _pyramid->levelHeight(level);
+	int x = tx * PYRAMID_TILE_SIZE;
+	int y = ty * PYRAMID_TILE_SIZE;
+	int w = qMin(PYRAMID_TILE_SIZE, lw - x);
+	int h = qMin(PYRAMID_TILE_SIZE, lh - y);
+	const uchar *start = _pyramid->level(level) + (size_t)y * lw + x;
+
+	/* Wraps the level's memory; fromImage makes the copy */
+	QImage image(start, w, h, lw, QImage::Format_Grayscale8);
+	pixmap = new QPixmap(QPixmap::fromImage(image));
+	_tiles.insert(key, pixmap, qMax(w * h / 1024, 1));
+
+	return _tiles.object(key);
+}
+
+void ImageView::paintEvent(QPaintEvent *)
+{
+	TRACE_SCOPE("ImageView::paintEvent");
+	QPainter painter(this);
+	painter.fillRect(rect(), Qt::white);
+
+	if (!_pyramid)
+	{
+		return;
+	}
+
+	/* Coarsest level which still has a texel per widget pixel */
+	double s = scale();
+	int level = 0;
+
+	while (level + 1 < _pyramid->readyLevels() &&
+	       s * pow(2, level + 1) <= 1)
+	{
+		level++;
+	}
+
+	double factor = pow(2, level);
+	double tileSize = PYRAMID_TILE_SIZE * factor;
+
+	/* Image area in view, clipped to the image */
+	double left = 0, top = 0;
+	double right = width(), bottom = height();
+	toImage(&left, &top);
+	toImage(&right, &bottom);
+
+	int tx0 = qMax(0, (int)floor(left / tileSize));
+	int ty0 = qMax(0, (int)floor(top / tileSize));
+	int tx1 = qMin((int)ceil(_pyramid->levelWidth(level) /
+	                         (double)PYRAMID_TILE_SIZE) - 1,
+	               (int)floor(right / tileSize));
+	int ty1 = qMin((int)ceil(_pyramid->levelHeight(level) /
+	                         (double)PYRAMID_TILE_SIZE) - 1,
+	               (int)floor(bottom / tileSize));
+
+	/* Pixel-level inspection wants hard pixel edges */
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, s < 1);
+
+	for (int ty = ty0; ty <= ty1; ty++)
+	{
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			QPixmap *pixmap = tile(level, tx, ty);
+			double x0 = tx * tileSize;
+			double y0 = ty * tileSize;
+			double x1 = x0 + pixmap->width() * factor;
+			double y1 = y0 + pixmap->height() * factor;
+			toWidget(&x0, &y0);
+			toWidget(&x1, &y1);
+
+			painter.drawPixmap(QRectF(x0, y0, x1 - x0, y1 - y0), *pixmap,
+			                   QRectF(pixmap->rect()));
+		}
+	}
+}
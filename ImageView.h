@@ -0,0 +1,75 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__ImageView__
+#define __Windexing__ImageView__
+
+#include "shared_ptrs.h"
+#include <QtWidgets/qwidget.h>
+#include <QtGui/qpixmap.h>
+#include <QtCore/qcache.h>
+
+/* Paints an image pyramid, choosing the level which matches the zoom and
+ * drawing only the tiles in view. Tiles are converted to pixmaps once and
+ * cached. At a zoom of one the whole image fits the widget. */
+
+class ImageView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    ImageView(QWidget *parent = 0);
+
+	/* Starts the pyramid building and resets the zoom */
+	void setPyramid(ImagePyramidPtr pyramid);
+
+	ImagePyramidPtr getPyramid()
+	{
+		return _pyramid;
+	}
+
+	/* Widget pixels per image pixel */
+	double scale();
+
+	/* Image pixel under a widget pixel, and back */
+	void toImage(double *x, double *y);
+	void toWidget(double *x, double *y);
+
+	/* Multiplies the zoom, keeping the image pixel under (x, y) still */
+	void zoomAt(double x, double y, double factor);
+
+	/* Moves the image by a number of widget pixels */
+	void pan(double dx, double dy);
+protected:
+	virtual void paintEvent(QPaintEvent *event);
+private:
+	static void levelReady(void *object);
+	double fitScale();
+	void clampCentre();
+	QPixmap *tile(int level, int tx, int ty);
+
+	ImagePyramidPtr _pyramid;
+	QCache<quint64, QPixmap> _tiles;
+
+	double _zoom;
+	double _centreX;
+	double _centreY;
+};
+
+#endif
@@ -0,0 +1,234 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "LookupGrid.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+/* Keeps very sparse, spread out predictions from making huge grids */
+#define MAX_CELLS_PER_POINT 4
+#define MIN_CELLS 4096
+
+LookupGrid::LookupGrid()
+{
+	clear();
+}
+
+void LookupGrid::clear()
+{
+	_xMin = 0;
+	_yMin = 0;
+	_cellSize = 1;
+	_cols = 0;
+	_rows = 0;
+	_cellStart.clear();
+	_indices.clear();
+	_x.clear();
+	_y.clear();
+}
+
+int LookupGrid::cellX(double x)
+{
+	int col = (int)floor((x - _xMin) / _cellSize);
+	return std::max(0, std::min(_cols - 1, col));
+}
+
+int LookupGrid::cellY(double y)
+{
+	int row = (int)floor((y - _yMin) / _cellSize);
+	return std::max(0, std::min(_rows - 1, row));
+}
+
+void LookupGrid::build(const double *x, const double *y,
+                       const unsigned char *flags, unsigned char flag,
+                       size_t count, double cellSize)
+{
+	clear();
+
+	double xMin = DBL_MAX, yMin = DBL_MAX;
+	double xMax = -DBL_MAX, yMax = -DBL_MAX;
+	size_t points = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!(flags[i] & flag)) continue;
+
+		xMin = std::min(xMin, x[i]);
+		xMax = std::max(xMax, x[i]);
+		yMin = std::min(yMin, y[i]);
+		yMax = std::max(yMax, y[i]);
+		points++;
+	}
+
+	if (points == 0)
+	{
+		return;
+	}
+
+	double width = xMax - xMin;
+	double height = yMax - yMin;
+	double maxCells = std::max((double)MIN_CELLS,
+	                           (double)points * MAX_CELLS_PER_POINT);
+
+	while ((width / cellSize + 1) * (height / cellSize + 1) > maxCells)
+	{
+		cellSize *= 2;
+	}
+
+	_xMin = xMin;
+	_yMin = yMin;
+	_cellSize = cellSize;
+	_cols = (int)(width / cellSize) + 1;
+	_rows = (int)(height / cellSize) + 1;
+
+	/* Counting sort: histogram, prefix sum, then scatter */
+	std::vector<int> cells(count, -1);
+	_cellStart.assign(_cols * _rows + 1, 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!(flags[i] & flag)) continue;
+
+		cells[i] = cellY(y[i]) * _cols + cellX(x[i]);
+		_cellStart[cells[i] + 1]++;
+	}
+
+	for (size_t i = 1; i < _cellStart.size(); i++)
+	{
+		_cellStart[i] += _cellStart[i - 1];
+	}
+
+	std::vector<int> next(_cellStart.begin(), _cellStart.end() - 1);
+	_indices.resize(points);
+	_x.resize(points);
+	_y.resize(points);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (cells[i] < 0) continue;
+
+		int j = next[cells[i]]++;
+		_indices[j] = i;
+		_x[j] = x[i];
+		_y[j] = y[i];
+	}
+}
+
+int LookupGrid::nearest(double x, double y, double maxDist)
+{
+	if (!_indices.size())
+	{
+		return -1;
+	}
+
+	int best = -1;
+	double bestSq = DBL_MAX;
+	int colMin = cellX(x - maxDist), colMax = cellX(x + maxDist);
+	int rowMin = cellY(y - maxDist), rowMax = cellY(y + maxDist);
+
+	for (int row = rowMin; row <= rowMax; row++)
+	{
+		for (int col = colMin; col <= colMax; col++)
+		{
+			int cell = row * _cols + col;
+
+			for (int j = _cellStart[cell]; j < _cellStart[cell + 1]; j++)
+			{
+				double dx = _x[j] - x;
+				double dy = _y[j] - y;
+
+				if (fabs(dx) > maxDist || fabs(dy) > maxDist)
+				{
+					continue;
+				}
+
+				double sq = dx * dx + dy * dy;
+
+				if (sq < bestSq)
+				{
+					bestSq = sq;
+					best = _indices[j];
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+void LookupGrid::inRectangle(double xMin, double yMin, double xMax,
+                             double yMax, std::vector<int> *found)
+{
+	if (!_indices.size())
+	{
+		return;
+	}
+
+	int colMin = cellX(xMin), colMax = cellX(xMax);
+	int rowMin = cellY(yMin), rowMax = cellY(yMax);
+
+	for (int row = rowMin; row <= rowMax; row++)
+	{
+		for (int col = colMin; col <= colMax; col++)
+		{
+			int cell = row * _cols + col;
+
+			for (int j = _cellStart[cell]; j < _cellStart[cell + 1]; j++)
+			{
+				if (_x[j] >= xMin && _x[j] <= xMax &&
+				    _y[j] >= yMin && _y[j] <= yMax)
+				{
+					found->push_back(_indices[j]);
+				}
+			}
+		}
+	}
+}
+
+void LookupGrid::inRadius(double x, double y, double radius,
+                          std::vector<int> *found)
+{
+	if (!_indices.size())
+	{
+		return;
+	}
+
+	int colMin = cellX(x - radius), colMax = cellX(x + radius);
+	int rowMin = cellY(y - radius), rowMax = cellY(y + radius);
+
+	for (int row = rowMin; row <= rowMax; row++)
+	{
+		for (int col = colMin; col <= colMax; col++)
+		{
+			int cell = row * _cols + col;
+
+			for (int j = _cellStart[cell]; j < _cellStart[cell + 1]; j++)
+			{
+				double dx = _x[j] - x;
+				double dy = _y[j] - y;
+
+				if (dx * dx + dy * dy <= radius * radius)
+				{
+					found->push_back(_indices[j]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__LookupGrid__
+#define __Windexing__LookupGrid__
+
+#include <vector>
+#include <stddef.h>
+
+/* Uniform grid over predicted spot positions, built in one counting-sort
+ * pass, for finding the spot under the mouse. Cells should be at least
+ * the picking distance so that a query only visits its 3x3 block. */
+
+class LookupGrid
+{
+public:
+	LookupGrid();
+
+	/* Only entries with the given flag bit set are indexed */
+	void build(const double *x, const double *y, const unsigned char *flags,
+	           unsigned char flag, size_t count, double cellSize);
+	void clear();
+
+	/* Nearest indexed point within the square of half-width maxDist, by
+	 * Euclidean distance; -1 if there is none. */
+	int nearest(double x, double y, double maxDist);
+	void inRadius(double x, double y, double radius, std::vector<int> *found);
+	void inRectangle(double xMin, double yMin, double xMax, double yMax,
+	                 std::vector<int> *found);
+
+	size_t count()
+	{
+		return _indices.size();
+	}
+private:
+	int cellX(double x);
+	int cellY(double y);
+
+	double _xMin;
+	double _yMin;
+	double _cellSize;
+	int _cols;
+	int _rows;
+	std::vector<int> _cellStart; // _cols * _rows + 1 offsets into _indices
+	std::vector<int> _indices;
+	std::vector<double> _x; // copies of the positions, in _indices order
+	std::vector<double> _y;
+};
+
+#endif
@@ -0,0 +1,63 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "MappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(std::string filename)
+{
+	_filename = filename;
+	_bytes = NULL;
+	_size = 0;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+
+	if (fd < 0)
+	{
+		return;
+	}
+
+	struct stat info;
+
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void *map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE,
+		                 MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED)
+		{
+			_bytes = static_cast<unsigned char *>(map);
+			_size = info.st_size;
+		}
+	}
+
+	/* The mapping outlives the descriptor */
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (_bytes != NULL)
+	{
+		munmap(_bytes, _size);
+	}
+}
@@ -0,0 +1,64 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__MappedFile__
+#define __Windexing__MappedFile__
+
+#include <string>
+#include <stddef.h>
+
+/* A whole file mapped into memory. The mapping is private, so pixels may
+ * be altered in place without touching the file. */
+
+class MappedFile
+{
+public:
+	MappedFile(std::string filename);
+	~MappedFile();
+
+	/* False if the file could not be opened or mapped */
+	bool isValid()
+	{
+		return (_bytes != NULL);
+	}
+
+	unsigned char *bytes()
+	{
+		return _bytes;
+	}
+
+	size_t size()
+	{
+		return _size;
+	}
+
+	std::string getFilename()
+	{
+		return _filename;
+	}
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	std::string _filename;
+	unsigned char *_bytes;
+	size_t _size;
+};
+
+#endif
@@ -0,0 +1,339 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "OrientationSearch.h"
+#include "Trace.h"
+#include "Crystal.h"
+#include "Detector.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <float.h>
+#include <iostream>
+
+OrientationSearch::OrientationSearch(Crystal *crystal, Detector *detector)
+{
+	_crystal = crystal;
+	_detector = detector;
+	_sampleCount = 1000000;
+	_candidateCount = 16;
+	_threads = 0;
+	_matches = 0;
+	_best.rotation = make_mat3x3();
+	_best.score = 0;
+}
+
+void OrientationSearch::addSpot(double x, double y)
+{
+	_pixels.push_back(make_vec2(x, y));
+}
+
+/* Van der Corput sequence in the given base */
+static double radical_inverse(int i, int base)
+{
+	double inverse = 1. / base;
+	double fraction = inverse;
+	double result = 0;
+
+	while (i > 0)
+	{
+		result += (i % base) * fraction;
+		i /= base;
+		fraction *= inverse;
+	}
+
+	return result;
+}
+
+/* Shoemake's mapping of the unit cube onto uniformly distributed unit
+ * quaternions, fed with a Halton sequence instead of random numbers */
+static mat3x3 quasi_random_rotation(int i)
+{
+	double u1 = radical_inverse(i + 1, 2);
+	double u2 = radical_inverse(i + 1, 3);
+	double u3 = radical_inverse(i + 1, 5);
+
+	double x = sqrt(1 - u1) * sin(2 * M_PI * u2);
+	double y = sqrt(1 - u1) * cos(2 * M_PI * u2);
+	double z = sqrt(u1) * sin(2 * M_PI * u3);
+	double w = sqrt(u1) * cos(2 * M_PI * u3);
+
+	mat3x3 mat;
+	mat.vals[0] = 1 - 2 * (y * y + z * z);
+	mat.vals[1] = 2 * (x * y - z * w);
+	mat.vals[2] = 2 * (x * z + y * w);
+	mat.vals[3] = 2 * (x * y + z * w);
+	mat.vals[4] = 1 - 2 * (x * x + z * z);
+	mat.vals[5] = 2 * (y * z - x * w);
+	mat.vals[6] = 2 * (x * z - y * w);
+	mat.vals[7] = 2 * (y * z + x * w);
+	mat.vals[8] = 1 - 2 * (x * x + y * y);
+
+	return mat;
+}
+
+static bool better_candidate(const OrientationCandidate &a,
+                             const OrientationCandidate &b)
+{
+	return a.score > b.score;
+}
+
+static bool shorter_spot(const std::pair<double, vec3> &a,
+                         const std::pair<double, vec3> &b)
+{
+	return a.first < b.first;
+}
+
+void OrientationSearch::prepareSpots()
+{
+	double invWavelength = 1 / _crystal->getWavelength();
+
+	_spots.clear();
+	_lengths.clear();
+
+	/* The diffracted ray through the spot has length 1 / wavelength and
+	 * starts at the sample, 1 / wavelength behind the origin */
+	std::vector<std::pair<double, vec3> > sorted;
+
+	for (size_t i = 0; i < _pixels.size(); i++)
+	{
+		vec3 ray = _detector->pixelDirection(_pixels[i].x, _pixels[i].y);
+		vec3_set_length(&ray, invWavelength);
+		ray.z -= invWavelength;
+
+		sorted.push_back(std::make_pair(vec3_length(ray), ray));
+	}
+
+	/* Innermost first, as these can be placed with the coarsest search */
+	std::sort(sorted.begin(), sorted.end(), shorter_spot);
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		_lengths.push_back(sorted[i].first);
+		_spots.push_back(sorted[i].second);
+	}
+
+	_unitCell = _crystal->getUnitCell();
+	_inverseCell = mat3x3_inverse(_unitCell);
+	_tolerance = _crystal->getRlpSize();
+
+	/* Never so loose that any spot would match some lattice point */
+	double shortest = FLT_MAX;
+
+	for (int i = 0; i < 3; i++)
+	{
+		vec3 axis = mat3x3_axis(_unitCell, i);
+		shortest = std::min(shortest, vec3_length(axis));
+	}
+
+	_maxTolerance = std::max(shortest / 4, _tolerance * 2);
+
+	double longest = *std::max_element(_lengths.begin(), _lengths.end());
+	_finestStep = _tolerance / std::max(longest, _tolerance) / 4;
+}
+
+/* Sums how closely each spot matches its nearest allowed lattice point.
+ * A spot moves by up to its length times the angle between neighbouring
+ * trial rotations, so the tolerance is widened accordingly. */
+double OrientationSearch::score(mat3x3 &rotation, double angleStep,
+                                int *matches)
+{
+	mat3x3 transpose = mat3x3_transpose(rotation);
+	mat3x3 toLattice = mat3x3_mult_mat3x3(_inverseCell, transpose);
+	double total = 0;
+	int count = 0;
+
+	for (size_t i = 0; i < _spots.size(); i++)
+	{
+		/* Spots too far out to be placed at this angular spacing would
+		 * only add matches by chance; spots are sorted by length */
+		double tolerance = _tolerance + _lengths[i] * angleStep / 2;
+
+		if (tolerance > _maxTolerance)
+		{
+			break;
+		}
+
+		vec3 frac = _spots[i];
+		mat3x3_mult_vec(toLattice, &frac);
+
+		int h = lrint(frac.x);
+		int k = lrint(frac.y);
+		int l = lrint(frac.z);
+
+		if ((h == 0 && k == 0 && l == 0) || _crystal->isSysabs(h, k, l))
+		{
+			continue;
+		}
+
+		vec3 offset = make_vec3(frac.x - h, frac.y - k, frac.z - l);
+		mat3x3_mult_vec(_unitCell, &offset);
+
+		double distance = vec3_length(offset);
+
+		if (distance < tolerance)
+		{
+			total += 1 - distance / tolerance;
+			count++;
+		}
+	}
+
+	if (matches != NULL)
+	{
+		*matches = count;
+	}
+
+	return total;
+}
+
+void OrientationSearch::refineCandidate(OrientationCandidate *candidate,
+                                        double angleStep)
+{
+	vec3 xAxis = make_vec3(1, 0, 0);
+	vec3 yAxis = make_vec3(0, 1, 0);
+	vec3 zAxis = make_vec3(0, 0, 1);
+	double step = angleStep / 2;
+	int moves = 0;
+
+	while (step >= _finestStep && moves < 100)
+	{
+		OrientationCandidate centre = *candidate;
+		centre.score = score(centre.rotation, step);
+		OrientationCandidate best = centre;
+
+		for (int a = -1; a <= 1; a++)
+		{
+			for (int b = -1; b <= 1; b++)
+			{
+				for (int c = -1; c <= 1; c++)
+				{
+					if (a == 0 && b == 0 && c == 0)
+					{
+						continue;
+					}
+
+					mat3x3 xRot = mat3x3_unit_vec_rotation(xAxis, a * step);
+					mat3x3 yRot = mat3x3_unit_vec_rotation(yAxis, b * step);
+					mat3x3 zRot = mat3x3_unit_vec_rotation(zAxis, c * step);
+					mat3x3 nudge = mat3x3_mult_mat3x3(zRot,
+					                   mat3x3_mult_mat3x3(yRot, xRot));
+
+					OrientationCandidate trial;
+					trial.rotation = mat3x3_mult_mat3x3(nudge,
+					                                    centre.rotation);
+					trial.score = score(trial.rotation, step);
+
+					if (trial.score > best.score)
+					{
+						best = trial;
+					}
+				}
+			}
+		}
+
+		*candidate = best;
+
+		/* Only tighten once the local grid is centred on the best */
+		if (best.score <= centre.score)
+		{
+			step /= 2;
+		}
+		else
+		{
+			moves++;
+		}
+	}
+
+	candidate->score = score(candidate->rotation, 0);
+}
+
+bool OrientationSearch::search()
+{
+	TRACE_SCOPE("OrientationSearch::search");
+	if (_pixels.size() == 0 || _sampleCount <= 0)
+	{
+		return false;
+	}
+
+	prepareSpots();
+
+	/* Samples cover 8 pi^2 of rotation space, so this is their spacing */
+	double angleStep = cbrt(8 * M_PI * M_PI / _sampleCount);
+	int threads = (_threads > 0 ? _threads : thread_count());
+	size_t keep = std::max(_candidateCount, 1);
+
+	std::vector<std::vector<OrientationCandidate> > kept(threads);
+
+	parallel_for(_sampleCount, threads, [&](size_t i, int t)
+	{
+		OrientationCandidate trial;
+		trial.rotation = quasi_random_rotation(i);
+		trial.score = score(trial.rotation, angleStep);
+
+		std::vector<OrientationCandidate> &mine = kept[t];
+
+		if (mine.size() >= keep && trial.score <= mine.back().score)
+		{
+			return;
+		}
+
+		mine.insert(std::upper_bound(mine.begin(), mine.end(), trial,
+		                             better_candidate), trial);
+
+		if (mine.size() > keep)
+		{
+			mine.pop_back();
+		}
+	}, 256);
+
+	std::vector<OrientationCandidate> candidates;
+
+	for (int t = 0; t < threads; t++)
+	{
+		candidates.insert(candidates.end(), kept[t].begin(), kept[t].end());
+	}
+
+	std::sort(candidates.begin(), candidates.end(), better_candidate);
+
+	if (candidates.size() > keep)
+	{
+		candidates.resize(keep);
+	}
+
+	parallel_for(candidates.size(), threads, [&](size_t i, int)
+	{
+		refineCandidate(&candidates[i], angleStep);
+	});
+
+	std::stable_sort(candidates.begin(), candidates.end(), better_candidate);
+
+	if (candidates.size() == 0 || candidates[0].score <= 0)
+	{
+		return false;
+	}
+
+	_best = candidates[0];
+	score(_best.rotation, 0, &_matches);
+
+	TRACE_LOG(TraceInfo, "Orientation search matched " << _matches << " of "
+	          << _spots.size() << " spots.");
+
+	_crystal->setRotation(_best.rotation);
+
+	return true;
+}
@@ -0,0 +1,117 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__OrientationSearch__
+#define __Windexing__OrientationSearch__
+
+#include <vector>
+#include "mat3x3.h"
+
+class Crystal;
+class Detector;
+
+typedef struct
+{
+	mat3x3 rotation;
+	double score;
+} OrientationCandidate;
+
+/* Finds the crystal rotation from spot positions on the detector and the
+ * known unit cell. Rotations are sampled evenly with a quasi-random
+ * sequence, each scored by how many spots sit close to an allowed lattice
+ * point, and the best few are refined by successively finer local grids. */
+
+class OrientationSearch
+{
+public:
+	OrientationSearch(Crystal *crystal, Detector *detector);
+
+	/* Detector position in pixels, as shown on the image */
+	void addSpot(double x, double y);
+
+	void clearSpots()
+	{
+		_pixels.clear();
+	}
+
+	size_t spotCount()
+	{
+		return _pixels.size();
+	}
+
+	std::vector<vec2> &getSpots()
+	{
+		return _pixels;
+	}
+
+	void setSampleCount(int count)
+	{
+		_sampleCount = count;
+	}
+
+	void setCandidateCount(int count)
+	{
+		_candidateCount = count;
+	}
+
+	/* Zero uses thread_count() */
+	void setThreads(int threads)
+	{
+		_threads = threads;
+	}
+
+	/* Returns false if there was nothing to search with. On success the
+	 * crystal is given the best rotation found. */
+	bool search();
+
+	mat3x3 getRotation()
+	{
+		return _best.rotation;
+	}
+
+	/* Number of spots explained by the best rotation */
+	int getMatches()
+	{
+		return _matches;
+	}
+private:
+	void prepareSpots();
+	double score(mat3x3 &rotation, double angleStep, int *matches = NULL);
+	void refineCandidate(OrientationCandidate *candidate, double angleStep);
+
+	Crystal *_crystal;
+	Detector *_detector;
+	std::vector<vec2> _pixels;
+	std::vector<vec3> _spots; // on the Ewald sphere, reciprocal space
+	std::vector<double> _lengths;
+
+	mat3x3 _unitCell;
+	mat3x3 _inverseCell;
+	double _tolerance;
+	double _maxTolerance;
+	double _finestStep;
+
+	int _sampleCount;
+	int _candidateCount;
+	int _threads;
+	OrientationCandidate _best;
+	int _matches;
+};
+
+#endif
@@ -0,0 +1,186 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "Parallel.h"
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdlib.h>
+#include <algorithm>
+
+int thread_count()
+{
+	const char *env = getenv("MANDEXING_THREADS");
+
+	if (env && atoi(env) > 0)
+	{
+		return atoi(env);
+	}
+
+	int hardware = std::thread::hardware_concurrency();
+	return (hardware > 0 ? hardware : 1);
+}
+
+/* One parallel_for call. The fields below next are guarded by the pool
+ * mutex; next is handed out to whichever workers join. */
+typedef struct
+{
+	std::function<void(size_t, int)> *job;
+	std::atomic<size_t> next;
+	size_t count;
+	size_t chunk;
+	int wanted; // helpers still to join
+	int joined; // helpers given a thread index so far
+	int running; // helpers still working
+} ParallelTask;
+
+/* Workers are started as needed and then wait for tasks until the
+ * program exits. Never freed, so that they may still be waiting on it
+ * while static objects are destroyed. */
+typedef struct
+{
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::deque<ParallelTask *> tasks;
+	int workers;
+} ParallelPool;
+
+static ParallelPool *make_pool()
+{
+	ParallelPool *pool = new ParallelPool();
+	pool->workers = 0;
+	return pool;
+}
+
+static ParallelPool *parallel_pool()
+{
+	static ParallelPool *pool = make_pool();
+	return pool;
+}
+
+static void run_chunks(ParallelTask *task, int thread)
+{
+	while (true)
+	{
+		size_t start = task->next.fetch_add(task->chunk);
+
+		if (start >= task->count)
+		{
+			return;
+		}
+
+		size_t end = std::min(start + task->chunk, task->count);
+
+		for (size_t i = start; i < end; i++)
+		{
+			(*task->job)(i, thread);
+		}
+	}
+}
+
+static void worker_loop(ParallelPool *pool)
+{
+	std::unique_lock<std::mutex> lock(pool->mutex);
+
+	while (true)
+	{
+		pool->wake.wait(lock, [pool]() { return !pool->tasks.empty(); });
+
+		ParallelTask *task = pool->tasks.front();
+		task->joined++;
+		task->running++;
+		int thread = task->joined;
+
+		if (--task->wanted == 0)
+		{
+			pool->tasks.pop_front();
+		}
+
+		lock.unlock();
+		run_chunks(task, thread);
+		lock.lock();
+
+		if (--task->running == 0)
+		{
+			pool->done.notify_all();
+		}
+	}
+}
+
+void parallel_for(size_t count, int threads,
+                  std::function<void(size_t, int)> job, size_t chunk)
+{
+	if (threads <= 0)
+	{
+		threads = thread_count();
+	}
+
+	if (chunk == 0)
+	{
+		chunk = 1;
+	}
+
+	size_t chunks = (count + chunk - 1) / chunk;
+	threads = std::max(1, (int)std::min((size_t)threads, chunks));
+
+	ParallelTask task;
+	task.job = &job;
+	task.next = 0;
+	task.count = count;
+	task.chunk = chunk;
+	task.wanted = threads - 1;
+	task.joined = 0;
+	task.running = 0;
+
+	ParallelPool *pool = parallel_pool();
+
+	if (threads > 1)
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+
+		while (pool->workers < threads - 1)
+		{
+			std::thread(worker_loop, pool).detach();
+			pool->workers++;
+		}
+
+		pool->tasks.push_back(&task);
+		pool->wake.notify_all();
+	}
+
+	/* Workers busy with other calls may never join, so the caller
+	 * carries on until every chunk is taken */
+	run_chunks(&task, 0);
+
+	if (threads > 1)
+	{
+		std::unique_lock<std::mutex> lock(pool->mutex);
+
+		if (task.wanted > 0)
+		{
+			pool->tasks.erase(std::find(pool->tasks.begin(),
+			                            pool->tasks.end(), &task));
+		}
+
+		pool->done.wait(lock, [&task]() { return task.running == 0; });
+	}
+}
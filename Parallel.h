@@ -0,0 +1,37 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__Parallel__
+#define __Windexing__Parallel__
+
+#include <functional>
+#include <stddef.h>
+
+/* Number of worker threads to use by default: the hardware concurrency,
+ * or the MANDEXING_THREADS environment variable if set. */
+int thread_count();
+
+/* Calls job(index, thread) for every index in [0, count), handing out
+ * indices in chunks to up to threads workers (thread_count() if zero).
+ * The calling thread is worker 0 and the others come from a pool which
+ * is started on first use and kept. Returns once every job has run. */
+void parallel_for(size_t count, int threads,
+                  std::function<void(size_t, int)> job, size_t chunk = 1);
+
+#endif
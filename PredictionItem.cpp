@@ -0,0 +1,274 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "PredictionItem.h"
+#include "Crystal.h"
+#include "Trace.h"
+#include <QtGui/qpainter.h>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+
+PredictionItem::PredictionItem(Crystal *crystal) : QGraphicsItem()
+{
+	_crystal = crystal;
+	_scaleX = 1;
+	_scaleY = 1;
+	_offsetX = 0;
+	_offsetY = 0;
+	_showWatched = false;
+	_watchedBrush = QBrush(QColor(0, 0, 255, 50));
+
+	for (int i = 0; i < PREDICTION_PEN_BUCKETS; i++)
+	{
+		double weight = (i + 0.5) / (double)PREDICTION_PEN_BUCKETS;
+		_pens[i] = QPen(QColor(0, 0, 255, (1 - weight) * 255));
+	}
+
+	makeSprites();
+}
+
+void PredictionItem::makeSprites()
+{
+	int size = PREDICTION_ELLIPSE_SIZE + 2 * PREDICTION_SPRITE_BORDER;
+	QRectF rect(PREDICTION_SPRITE_BORDER, PREDICTION_SPRITE_BORDER,
+	            PREDICTION_ELLIPSE_SIZE, PREDICTION_ELLIPSE_SIZE);
+
+	for (int i = 0; i < PREDICTION_PEN_BUCKETS; i++)
+	{
+		_sprites[i] = QImage(size, size, QImage::Format_ARGB32_Premultiplied);
+		_sprites[i].fill(0);
+		QPainter painter(&_sprites[i]);
+		painter.setPen(_pens[i]);
+		painter.setBrush(Qt::NoBrush);
+		painter.drawEllipse(rect);
+	}
+
+	_watchedSprite = QImage(size, size, QImage::Format_ARGB32_Premultiplied);
+	_watchedSprite.fill(0);
+	QPainter painter(&_watchedSprite);
+	painter.setPen(Qt::NoPen);
+	painter.setBrush(_watchedBrush);
+	painter.drawEllipse(rect);
+}
+
+/* Source-over for one premultiplied pixel: each channel of dst is scaled
+ * by (255 - source alpha) / 255, two channels at a time */
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src)
+{
+	uint32_t inverse = 255 - (src >> 24);
+	uint32_t rb = (dst & 0xff00ff) * inverse;
+	uint32_t ag = ((dst >> 8) & 0xff00ff) * inverse;
+	rb = ((rb + ((rb >> 8) & 0xff00ff) + 0x800080) >> 8) & 0xff00ff;
+	ag = (ag + ((ag >> 8) & 0xff00ff) + 0x800080) & 0xff00ff00;
+
+	return src + (rb | ag);
+}
+
+/* Blends the sprite into the target with its top left corner at (x, y),
+ * clipped to the target */
+static void blend_sprite(uchar *target, int stride, int width, int height,
+                         const QImage &sprite, int x, int y)
+{
+	int x0 = std::max(0, -x);
+	int y0 = std::max(0, -y);
+	int x1 = std::min(sprite.width(), width - x);
+	int y1 = std::min(sprite.height(), height - y);
+
+	for (int j = y0; j < y1; j++)
+	{
+		const uint32_t *src = (const uint32_t *)sprite.constScanLine(j);
+		uint32_t *dst = (uint32_t *)(target + (size_t)(y + j) * stride) + x;
+
+		for (int i = x0; i < x1; i++)
+		{
+			uint32_t pixel = src[i];
+
+			if (pixel)
+			{
+				dst[i] = blend_pixel(dst[i], pixel);
+			}
+		}
+	}
+}
+
+void PredictionItem::setMapping(double scaleX, double scaleY,
+                                double offsetX, double offsetY,
+                                QRectF bounds)
+{
+	if (bounds != _bounds)
+	{
+		prepareGeometryChange();
+	}
+
+	_scaleX = scaleX;
+	_scaleY = scaleY;
+	_offsetX = offsetX;
+	_offsetY = offsetY;
+	_bounds = bounds;
+	update();
+}
+
+QRectF PredictionItem::boundingRect() const
+{
+	return _bounds;
+}
+
+void PredictionItem::paint(QPainter *painter,
+                           const QStyleOptionGraphicsItem *,
+                           QWidget *)
+{
+	TRACE_SCOPE("PredictionItem::paint");
+	ReflectionList *refls = _crystal->reflections();
+	double half = PREDICTION_ELLIPSE_SIZE / 2;
+
+	/* Only spots which would touch the visible area are kept */
+	double reach = half + PREDICTION_SPRITE_BORDER;
+	double xMin = _bounds.left() - reach;
+	double yMin = _bounds.top() - reach;
+	double xMax = _bounds.right() + reach;
+	double yMax = _bounds.bottom() + reach;
+	size_t total = 0;
+
+	for (int b = 0; b < PREDICTION_PEN_BUCKETS; b++)
+	{
+		_buckets[b].clear();
+	}
+
+	_watched.clear();
+
+	for (size_t i = 0; i < refls->size(); i++)
+	{
+		if (!(refls->flags[i] & ReflectionOnImage))
+		{
+			continue;
+		}
+
+		double weight = refls->weight[i];
+		if (weight < 0) continue;
+
+		double x = refls->posX[i] * _scaleX + _offsetX;
+		double y = refls->posY[i] * _scaleY + _offsetY;
+
+		if (x < xMin || y < yMin || x > xMax || y > yMax)
+		{
+			continue;
+		}
+
+		int bucket = weight * PREDICTION_PEN_BUCKETS;
+		if (bucket >= PREDICTION_PEN_BUCKETS)
+		{
+			bucket = PREDICTION_PEN_BUCKETS - 1;
+		}
+
+		QRectF rect(x - half, y - half, PREDICTION_ELLIPSE_SIZE,
+		            PREDICTION_ELLIPSE_SIZE);
+		_buckets[bucket].push_back(rect);
+		total++;
+
+		if (_showWatched && (refls->flags[i] & ReflectionWatched))
+		{
+			_watched.push_back(rect);
+		}
+	}
+
+	if (total > PREDICTION_RASTER_THRESHOLD)
+	{
+		paintRaster(painter);
+	}
+	else
+	{
+		paintVector(painter);
+	}
+}
+
+void PredictionItem::paintVector(QPainter *painter)
+{
+	painter->setPen(Qt::NoPen);
+	painter->setBrush(_watchedBrush);
+
+	for (size_t i = 0; i < _watched.size(); i++)
+	{
+		painter->drawEllipse(_watched[i]);
+	}
+
+	painter->setBrush(Qt::NoBrush);
+
+	for (int b = 0; b < PREDICTION_PEN_BUCKETS; b++)
+	{
+		if (!_buckets[b].size())
+		{
+			continue;
+		}
+
+		painter->setPen(_pens[b]);
+
+		for (size_t i = 0; i < _buckets[b].size(); i++)
+		{
+			painter->drawEllipse(_buckets[b][i]);
+		}
+	}
+}
+
+/* Spots snap to whole pixels here, which is not visible at the density
+ * at which this path is taken */
+void PredictionItem::paintRaster(QPainter *painter)
+{
+	TRACE_SCOPE("PredictionItem::paintRaster");
+	int width = ceil(_bounds.width());
+	int height = ceil(_bounds.height());
+
+	if (width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	if (_raster.width() != width || _raster.height() != height)
+	{
+		_raster = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+	}
+
+	_raster.fill(0);
+
+	uchar *bits = _raster.bits();
+	int stride = _raster.bytesPerLine();
+	double left = _bounds.left() + PREDICTION_SPRITE_BORDER;
+	double top = _bounds.top() + PREDICTION_SPRITE_BORDER;
+
+	for (size_t i = 0; i < _watched.size(); i++)
+	{
+		blend_sprite(bits, stride, width, height, _watchedSprite,
+		             lrint(_watched[i].left() - left),
+		             lrint(_watched[i].top() - top));
+	}
+
+	for (int b = 0; b < PREDICTION_PEN_BUCKETS; b++)
+	{
+		std::vector<QRectF> &rects = _buckets[b];
+
+		for (size_t i = 0; i < rects.size(); i++)
+		{
+			blend_sprite(bits, stride, width, height, _sprites[b],
+			             lrint(rects[i].left() - left),
+			             lrint(rects[i].top() - top));
+		}
+	}
+
+	painter->drawImage(_bounds.topLeft(), _raster);
+}
@@ -0,0 +1,87 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__PredictionItem__
+#define __Windexing__PredictionItem__
+
+#include <vector>
+#include <QtWidgets/qgraphicsitem.h>
+#include <QtGui/qpen.h>
+#include <QtGui/qimage.h>
+
+#define PREDICTION_PEN_BUCKETS 8
+#define PREDICTION_ELLIPSE_SIZE 10
+#define PREDICTION_SPRITE_BORDER 2
+#define PREDICTION_RASTER_THRESHOLD 2000
+
+class Crystal;
+
+/* A single, long-lived scene item which paints every predicted spot
+ * straight from the crystal's reflection arrays. Weights are quantised
+ * into a few pens so that the painter state changes only per bucket.
+ * Above PREDICTION_RASTER_THRESHOLD spots, each bucket's marker is drawn
+ * once into a sprite and the sprites are blended into one image, which
+ * is then painted in a single call. */
+
+class PredictionItem : public QGraphicsItem
+{
+public:
+	PredictionItem(Crystal *crystal);
+
+	/* Maps detector positions (relative to the beam centre) into the
+	 * scene: scene = position * scale + offset */
+	void setMapping(double scaleX, double scaleY, double offsetX,
+	                double offsetY, QRectF bounds);
+
+	void setShowWatched(bool show)
+	{
+		_showWatched = show;
+	}
+
+	virtual QRectF boundingRect() const;
+	virtual void paint(QPainter *painter,
+	                   const QStyleOptionGraphicsItem *option,
+	                   QWidget *widget = 0);
+private:
+	void makeSprites();
+	void paintVector(QPainter *painter);
+	void paintRaster(QPainter *painter);
+
+	Crystal *_crystal;
+	double _scaleX;
+	double _scaleY;
+	double _offsetX;
+	double _offsetY;
+	QRectF _bounds;
+	bool _showWatched;
+
+	QPen _pens[PREDICTION_PEN_BUCKETS];
+	QBrush _watchedBrush;
+
+	/* Kept between paints so that their storage is reused */
+	std::vector<QRectF> _buckets[PREDICTION_PEN_BUCKETS];
+	std::vector<QRectF> _watched;
+
+	/* Premultiplied ARGB, for the raster path */
+	QImage _sprites[PREDICTION_PEN_BUCKETS];
+	QImage _watchedSprite;
+	QImage _raster;
+};
+
+#endif
@@ -19,11 +19,14 @@
 #include "PredictionView.h"
 #include <iostream>
 #include <Qt3DInput/qmouseevent.h>
+#include <QtGui/qevent.h>
 #include "Tinker.h"
 #include <vector>
 #include <algorithm>
+#include <math.h>
 
 #include "FileReader.h"
+#include "Trace.h"
 
 #include <QtWidgets/qmessagebox.h>
 #include <QtWidgets/qwidget.h>
@@ -33,21 +36,82 @@
 #include <QtGui/qpixmap.h>
 #include <QtWidgets/qfiledialog.h>
 #include <QtWidgets/qgraphicsview.h>
+#include <QtGui/qguiapplication.h>
+#include <QtGui/qscreen.h>
 
 #define MOUSE_SENSITIVITY 1000
+/* Used when the screen does not report its refresh rate */
+#define DEFAULT_REFRESH_RATE 60
+/* Zoom per notch of the mouse wheel */
+#define WHEEL_ZOOM 1.25
 
 PredictionView::PredictionView(QWidget *parent) : QGraphicsView(parent)
 {
     _lastX = -1;
     _lastY = -1;
+    _panX = 0;
+    _panY = 0;
     _crystal = 0;
     _tinker = 0;
-    _keyPresses = 0;
-    _keyPressSwitch = 5;
     _fixAxisStage = 0;
     _refineStage = 0;
 	_identifyHklStage = 0;
     _radPerKeyPress = 1. / 500.;
+	_pendingHoriz = 0;
+	_pendingVert = 0;
+	_pendingTwist = 0;
+
+	double rate = DEFAULT_REFRESH_RATE;
+	QScreen *screen = QGuiApplication::primaryScreen();
+
+	if (screen && screen->refreshRate() > 1)
+	{
+		rate = screen->refreshRate();
+	}
+
+	_frameTimer = new QTimer(this);
+	_frameTimer->setSingleShot(true);
+	_frameTimer->setTimerType(Qt::PreciseTimer);
+	_frameTimer->setInterval(lrint(1000 / rate));
+	connect(_frameTimer, SIGNAL(timeout()), this, SLOT(applyPendingRotation()));
+}
+
+void PredictionView::queueRotation(double horiz, double vert, double twist)
+{
+	_pendingHoriz += horiz;
+	_pendingVert += vert;
+	_pendingTwist += twist;
+
+	/* Events arriving before the timer fires join the same update */
+	if (!_frameTimer->isActive())
+	{
+		_frameTimer->start();
+	}
+}
+
+void PredictionView::applyPendingRotation()
+{
+	if (_pendingHoriz == 0 && _pendingVert == 0 && _pendingTwist == 0)
+	{
+		return;
+	}
+
+	TRACE_LOG(TraceDebug, "Applying rotation " << _pendingHoriz << ", "
+	          << _pendingVert << ", " << _pendingTwist);
+
+	/* Crystal repopulates by itself once the rotation leaves its buffer */
+	_crystal->applyRotation(_pendingHoriz, _pendingVert, _pendingTwist);
+	_pendingHoriz = 0;
+	_pendingVert = 0;
+	_pendingTwist = 0;
+
+	_tinker->drawPredictions();
+}
+
+void PredictionView::flushRotation()
+{
+	_frameTimer->stop();
+	applyPendingRotation();
 }
 
 void PredictionView::keyPressEvent(QKeyEvent *event)
@@ -76,21 +140,27 @@ void PredictionView::keyPressEvent(QKeyEvent *event)
         return;
     }
     
-    _keyPresses++;
+    queueRotation(diffX, diffY, 0);
+}
 
-    _crystal->applyRotation(diffX, diffY, 0);
-    
-    if (_keyPresses > _keyPressSwitch)
-    {
-        _keyPresses = 0;
-        _crystal->populateMillers();
-    }
-    
-    _tinker->drawPredictions();
+void PredictionView::wheelEvent(QWheelEvent *e)
+{
+	double notches = e->angleDelta().y() / 120.;
+	_tinker->zoomImage(e->pos().x(), e->pos().y(), pow(WHEEL_ZOOM, notches));
+	e->accept();
 }
 
 void PredictionView::mousePressEvent(QMouseEvent *e)
 {
+	flushRotation();
+
+	if (e->button() == Qt::MiddleButton)
+	{
+		_panX = e->x();
+		_panY = e->y();
+		return;
+	}
+
     if (_fixAxisStage >= 1)
     {
         vec3 position = make_vec3(e->x(), e->y(), 0);
@@ -115,7 +185,7 @@ void PredictionView::mousePressEvent(QMouseEvent *e)
         
         if (num < 0)
         {
-            std::cout << "Missed..." << std::endl;
+            TRACE_LOG(TraceDebug, "Missed...");
             return;
         }
         
@@ -172,6 +242,15 @@ void PredictionView::mousePressEvent(QMouseEvent *e)
 
 void PredictionView::mouseMoveEvent(QMouseEvent *e)
 {
+	if (e->buttons() & Qt::MiddleButton)
+	{
+		_tinker->panImage(e->x() - _panX, e->y() - _panY);
+		_panX = e->x();
+		_panY = e->y();
+		e->accept();
+		return;
+	}
+
     if (_refineStage >= 1 || _fixAxisStage >= 1)
     {
         e->ignore();
@@ -206,15 +285,7 @@ void PredictionView::mouseMoveEvent(QMouseEvent *e)
             std::cout << "No crystal set!" << std::endl;
         }
 
-		std::cout << "Applying rotation " << dot << std::endl;
-        _crystal->applyRotation(0, 0, dot);
-        
-        if (!_tinker)
-        {
-            std::cout << "No tinker set!" << std::endl;        
-        }
-        
-        _tinker->drawPredictions();
+        queueRotation(0, 0, dot);
     }
     
     _lastX = newX; _lastY = newY;
@@ -224,6 +295,7 @@ void PredictionView::mouseMoveEvent(QMouseEvent *e)
 
 void PredictionView::setFixAxisStage(int stage)
 {
+	flushRotation();
     _fixAxisStage = stage;
     
     if (stage > 0)
@@ -265,6 +337,7 @@ void PredictionView::setIdentifyHklStage(int stage)
 
 void PredictionView::setRefineStage(int stage)
 {
+	flushRotation();
     _refineStage = stage;
     
     if (stage > 0)
@@ -23,6 +23,7 @@
 #include "Detector.h"
 #include "shared_ptrs.h"
 #include <QtWidgets/qgraphicsview.h>
+#include <QtCore/qtimer.h>
 
 class Tinker;
 
@@ -51,17 +52,22 @@ public:
     void setRadiansPerKeyPress(double rad)
     {
         _radPerKeyPress = rad;
-        _keyPressSwitch = deg2rad(0.5) / rad;
     }
 
+    /* Applies any rotation still waiting for the next frame */
+    void flushRotation();
+
     void setFixAxisStage(int stage);
     void setRefineStage(int stage);
     void setIdentifyHklStage(int stage);
     virtual void fitInView(const QRectF &rect, Qt::AspectRatioMode aspectRatioMode);
+private slots:
+	void applyPendingRotation();
 protected:
     virtual void mousePressEvent(QMouseEvent *e);
     virtual void mouseMoveEvent(QMouseEvent *e);
     virtual void keyPressEvent(QKeyEvent *event);
+    virtual void wheelEvent(QWheelEvent *event);
    
     Detector *_detector; 
     Crystal *_crystal;
@@ -69,15 +75,24 @@ protected:
     
     int _lastX;
     int _lastY;
+
+	/* Last position while dragging with the middle button */
+	int _panX;
+	int _panY;
     
-    int _keyPresses;
-    int _keyPressSwitch;
-        
     int _fixAxisStage;
     int _refineStage;
 	int _identifyHklStage;
 
     double _radPerKeyPress;
+
+	/* Input only adds to these; the frame timer applies the sum and
+	 * redraws at most once per frame */
+	void queueRotation(double horiz, double vert, double twist);
+	double _pendingHoriz;
+	double _pendingVert;
+	double _pendingTwist;
+	QTimer *_frameTimer;
     
 	int _singleWatch;
     
@@ -0,0 +1,155 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "RawFrameReader.h"
+#include "MappedFile.h"
+#include "ImageFrame.h"
+#include "FileReader.h"
+#include <string.h>
+#include <stdlib.h>
+
+bool RawFrameReader::canRead(MappedFilePtr file)
+{
+	size_t length = strlen(RAW_FRAME_MAGIC);
+
+	return (file->size() > length &&
+	        memcmp(file->bytes(), RAW_FRAME_MAGIC, length) == 0);
+}
+
+static bool host_is_little_endian()
+{
+	uint16_t test = 1;
+	return (*reinterpret_cast<unsigned char *>(&test) == 1);
+}
+
+ImageFramePtr RawFrameReader::read(MappedFilePtr file)
+{
+	const char *text = reinterpret_cast<const char *>(file->bytes());
+	size_t size = file->size();
+	size_t pos = 0;
+	int width = 0;
+	int height = 0;
+	int bits = 16;
+	int isSigned = -1;
+	bool little = true;
+	bool ended = false;
+
+	while (pos < size && !ended)
+	{
+		const char *end = static_cast<const char *>(memchr(text + pos, '\n',
+		                                                   size - pos));
+
+		if (end == NULL)
+		{
+			break;
+		}
+
+		std::string line(text + pos, end - (text + pos));
+		pos = end - text + 1;
+		trim(line);
+
+		std::vector<std::string> words = split(line, ' ');
+
+		if (line == "end")
+		{
+			ended = true;
+		}
+		else if (words.size() < 2 || line == RAW_FRAME_MAGIC)
+		{
+			continue;
+		}
+		else if (words[0] == "width")
+		{
+			width = atoi(words[1].c_str());
+		}
+		else if (words[0] == "height")
+		{
+			height = atoi(words[1].c_str());
+		}
+		else if (words[0] == "bits")
+		{
+			bits = atoi(words[1].c_str());
+		}
+		else if (words[0] == "signed")
+		{
+			isSigned = atoi(words[1].c_str());
+		}
+		else if (words[0] == "endian")
+		{
+			little = (words[1] != "big");
+		}
+	}
+
+	if (!ended || width <= 0 || height <= 0 || (bits != 16 && bits != 32))
+	{
+		_error = file->getFilename() + ": incomplete raw frame header.";
+		return ImageFramePtr();
+	}
+
+	if (isSigned < 0)
+	{
+		isSigned = (bits == 32);
+	}
+
+	size_t count = (size_t)width * height;
+	size_t bytes = bits / 8;
+
+	if (size - pos < count * bytes)
+	{
+		_error = file->getFilename() + ": file ends before the last pixel.";
+		return ImageFramePtr();
+	}
+
+	unsigned char *data = file->bytes() + pos;
+
+	if (bits == 32 && isSigned && little == host_is_little_endian() &&
+	    (reinterpret_cast<size_t>(data) % sizeof(int32_t)) == 0)
+	{
+		return ImageFramePtr(new ImageFrame(width, height,
+		                                    reinterpret_cast<int32_t *>(data),
+		                                    file));
+	}
+
+	ImageFramePtr frame = ImageFramePtr(new ImageFrame(width, height));
+	int32_t *pixels = frame->data();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned char *p = data + i * bytes;
+		uint32_t value = 0;
+
+		for (size_t b = 0; b < bytes; b++)
+		{
+			size_t shift = (little ? b : bytes - 1 - b) * 8;
+			value |= (uint32_t)p[b] << shift;
+		}
+
+		if (bits == 16)
+		{
+			pixels[i] = (isSigned ? (int16_t)value : (int32_t)value);
+		}
+		else
+		{
+			/* Unsigned values past the signed range cannot be held */
+			pixels[i] = (isSigned || value <= INT32_MAX ? (int32_t)value : -1);
+		}
+	}
+
+	return frame;
+}
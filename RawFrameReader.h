@@ -0,0 +1,48 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__RawFrameReader__
+#define __Windexing__RawFrameReader__
+
+#include "FrameReader.h"
+
+#define RAW_FRAME_MAGIC "MANDEXING RAW"
+
+/* Flat binary frames behind a short text header, one setting per line:
+ *
+ *   MANDEXING RAW
+ *   width 4096
+ *   height 4096
+ *   bits 16         (16 or 32)
+ *   signed 0        (default 0 for 16 bits, 1 for 32)
+ *   endian little   (little or big)
+ *   end
+ *
+ * Pixels follow straight after the newline ending "end". Little-endian,
+ * signed 32-bit frames whose pixels start on a four-byte boundary are used
+ * in place; others are decoded once into the frame. */
+
+class RawFrameReader : public FrameReader
+{
+public:
+	virtual bool canRead(MappedFilePtr file);
+	virtual ImageFramePtr read(MappedFilePtr file);
+};
+
+#endif
@@ -36,90 +36,169 @@
 #include "CSV.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include "FileReader.h"
+#include "Parallel.h"
 
-int RefinementGridSearch::_refine_counter = 0;
+std::atomic<int> RefinementGridSearch::_refine_counter(0);
 
-void RefinementGridSearch::recursiveEvaluation(ParamList referenceList, ParamList workingList, ResultMap *results)
+ParamList RefinementGridSearch::paramsForPoint(size_t point)
 {
-    size_t paramCount = objects.size();
-    size_t workingCount = workingList.size();
-	double grid_length = stepSizes[workingCount] / otherValues[workingCount];
+	ParamList params(_gridSize.size());
 
-    if (workingCount < paramCount)
-    {
-        if (workingCount == 1)
-        {
-       //     std::cout << "." << std::flush;
-        }
-        
-        for (int i = -grid_length / 2; i <= (int)(grid_length / 2 + 0.5); i++)
-        {
-            double mean = referenceList[workingCount];
-            double step = otherValues[workingCount];
-            double value = mean + i * step;
-            
-            ParamList extended = workingList;
-            extended.push_back(value);
-            recursiveEvaluation(referenceList, extended, results);
-        }
-        
-        return;
-    }
-    
-    for (size_t i = 0; i < workingList.size(); i++)
-    {
-        Setter setter = setters[i];
-        (*setter)(objects[i], workingList[i]);
-    }
-    
-    double result = (*evaluationFunction)(evaluateObject);
-    (*results)[workingList] = result;
-	reverseResults[result] = workingList;
-    
-    orderedParams.push_back(workingList);
-    orderedResults.push_back(result);
-    
-    reportProgress(result);
+	for (int i = (int)_gridSize.size() - 1; i >= 0; i--)
+	{
+		int step = _gridStart[i] + (int)(point % _gridSize[i]);
+		point /= _gridSize[i];
+		params[i] = _centre[i] + step * otherValues[i];
+	}
+
+	return params;
+}
+
+void RefinementGridSearch::evaluateGrid()
+{
+	size_t total = _results.size();
+	bool cloneable = (_cloner != NULL && _deleter != NULL);
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (objects[i] != evaluateObject)
+		{
+			cloneable = false;
+		}
+	}
+
+	int threads = (cloneable ? (_threads > 0 ? _threads : thread_count()) : 1);
+
+	if (threads <= 1)
+	{
+		for (size_t p = 0; p < total; p++)
+		{
+			if (isCancelled())
+			{
+				_results[p] = FLT_MAX;
+				continue;
+			}
+
+			ParamList params = paramsForPoint(p);
+
+			for (size_t i = 0; i < params.size(); i++)
+			{
+				(*setters[i])(objects[i], params[i]);
+			}
+
+			_results[p] = (*evaluationFunction)(evaluateObject);
+		}
+
+		return;
+	}
+
+	std::vector<void *> contexts(threads, (void *)NULL);
+
+	for (int t = 0; t < threads; t++)
+	{
+		contexts[t] = (*_cloner)(evaluateObject);
+	}
+
+	parallel_for(total, threads, [&](size_t p, int t)
+	{
+		if (isCancelled())
+		{
+			_results[p] = FLT_MAX;
+			return;
+		}
+
+		ParamList params = paramsForPoint(p);
+
+		for (size_t i = 0; i < params.size(); i++)
+		{
+			(*setters[i])(contexts[t], params[i]);
+		}
+
+		_results[p] = (*evaluationFunction)(contexts[t]);
+	});
+
+	for (int t = 0; t < threads; t++)
+	{
+		(*_deleter)(contexts[t]);
+	}
+}
+
+std::vector<double> RefinementGridSearch::getNextResult(int num)
+{
+	std::vector<size_t> order(_results.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return _results[a] < _results[b];
+	});
+
+	return paramsForPoint(order[num]);
 }
 
 void RefinementGridSearch::refine()
 {
     RefinementStrategy::refine();
     
-    ParamList currentValues;
     CSVPtr csv = CSVPtr(new CSV());
+    _centre.clear();
+    _gridStart.clear();
+    _gridSize.clear();
+    size_t total = 1;
 
     for (size_t i = 0; i < objects.size(); i++)
     {
         Getter getter = getters[i];
-        currentValues.push_back((*getter)(objects[i]));
+        _centre.push_back((*getter)(objects[i]));
         csv->addHeader(tags[i]);
+
+        double grid_length = stepSizes[i] / otherValues[i];
+        int start = -grid_length / 2;
+        int end = (int)(grid_length / 2 + 0.5);
+        _gridStart.push_back(start);
+        _gridSize.push_back(end - start + 1);
+        total *= end - start + 1;
     }
     
     csv->addHeader("result");
     
-    recursiveEvaluation(currentValues, ParamList(), &results);
+    _results.assign(total, 0);
+    evaluateGrid();
 
-    double minResult = (*evaluationFunction)(evaluateObject);
-    ParamList minParams;
+    /* Plain reduction over the flat array, against the score at the
+     * starting point; ties go to the earlier point */
+    double minResult = startingScore;
+    size_t minPoint = 0;
 	bool changed = false;
 
-    for (ResultMap::iterator it = results.begin(); it != results.end(); it++)
+    for (size_t p = 0; p < total; p++)
     {
-        if (it->second < minResult)
+        if (_results[p] < minResult)
         {
-            minResult = it->second;
-            minParams = it->first;
+            minResult = _results[p];
+            minPoint = p;
 			changed = true;
         }
-        
-        std::vector<double> result = it->first;
-        result.push_back(it->second);
-        
-        csv->addEntry(result);
     }
 
+	if (_writeCSV)
+	{
+		for (size_t p = 0; p < total; p++)
+		{
+			std::vector<double> result = paramsForPoint(p);
+			result.push_back(_results[p]);
+			csv->addEntry(result);
+		}
+	}
+
+	ParamList minParams = paramsForPoint(minPoint);
+
 	for (size_t i = 0; i < minParams.size(); i++)
 	{
 		Setter setter = setters[i];
@@ -130,16 +209,19 @@ void RefinementGridSearch::refine()
 		}
 		else
 		{
-			(*setter)(objects[i], currentValues[i]);
+			(*setter)(objects[i], _centre[i]);
 		}
 	}
 
+	reportProgress(minResult);
+	int counter = _refine_counter++;
+
 	if (tags.size() == 2)
 	{
 		int stride = stepSizes[0] / otherValues[0];
 
 		std::map<std::string, std::string> plotMap;
-		plotMap["filename"] = jobName + "_gridsearch_" + i_to_str(_refine_counter);
+		plotMap["filename"] = jobName + "_gridsearch_" + i_to_str(counter);
 		plotMap["height"] = "800";
 		plotMap["width"] = "800";
 		plotMap["xHeader0"] = tags[0];
@@ -158,8 +240,5 @@ void RefinementGridSearch::refine()
 		csv->writeToFile(jobName + "_gridsearch.csv");
 	}
 
-	_refine_counter++;
-
     finish();
 }
-
@@ -35,12 +35,10 @@
 #define __cppxfel__RefinementGridSearch__
 
 #include <stdio.h>
-#include <map>
+#include <atomic>
 #include "RefinementStrategy.h"
 
 typedef std::vector<double> ParamList;
-typedef std::map<ParamList, double> ResultMap;
-typedef std::map<double, ParamList> ReverseMap;
 
 class RefinementGridSearch : public RefinementStrategy
 {
@@ -48,10 +46,20 @@ private:
     int gridLength;
     int gridJumps;
 	bool _writeCSV;
-	ReverseMap reverseResults;
-    std::vector<double> orderedResults;
-    std::vector<ParamList> orderedParams;
-	static int _refine_counter; /* thread care! */
+	static std::atomic<int> _refine_counter;
+
+	Cloner _cloner;
+	Deleter _deleter;
+	int _threads;
+
+	/* Flat, row-major grid: the last parameter varies fastest */
+	std::vector<int> _gridStart;
+	std::vector<int> _gridSize;
+	ParamList _centre;
+	std::vector<double> _results;
+
+	ParamList paramsForPoint(size_t point);
+	void evaluateGrid();
 
 public:
     RefinementGridSearch() : RefinementStrategy()
@@ -60,6 +68,9 @@ public:
         gridLength = 15;
         cycleNum = 1;
 		_writeCSV = false;
+		_cloner = NULL;
+		_deleter = NULL;
+		_threads = 0;
     };
     
     void setGridLength(int length)
@@ -71,26 +82,32 @@ public:
     {
         gridJumps = _jumps;
     }
-    
-    ResultMap results;
-    void recursiveEvaluation(ParamList referenceList, ParamList workingList, ResultMap *results);
 
-	std::vector<double> getNextResult(int num)
+	/* With these, each worker thread evaluates on its own clone of the
+	 * evaluation object. Parameters must then belong to that object. */
+	void setCloneFunctions(Cloner clone, Deleter remove)
 	{
-		ReverseMap::iterator it = reverseResults.begin();
+		_cloner = clone;
+		_deleter = remove;
+	}
 
-		for (int i = 0; i < num; i++)
-		{
-			it++;
-		}
+	/* Zero uses thread_count() */
+	void setThreads(int threads)
+	{
+		_threads = threads;
+	}
 
-		return it->second;
+	size_t pointCount()
+	{
+		return _results.size();
 	}
 
+	/* Parameters of the num-th best grid point, best first */
+	std::vector<double> getNextResult(int num);
+
 	virtual void clearParameters()
     {
-        orderedResults.clear();
-        orderedParams.clear();
+        _results.clear();
         RefinementStrategy::clearParameters();
     }
     virtual void refine();
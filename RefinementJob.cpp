@@ -0,0 +1,176 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "RefinementJob.h"
+#include "Trace.h"
+#include "RefinementLevenbergMarquardt.h"
+#include "RefinementGridSearch.h"
+
+RefinementJob::RefinementJob(Crystal *crystal, Detector *detector)
+: _snapshot(*crystal), _detector(*detector)
+{
+	_snapshot.setRedrawFunction(RefinementJob::publishProgress, this);
+	_snapshot.setProgressFunction(NULL, NULL);
+	/* The display may run in single precision, refinement must not */
+	_snapshot.reflections()->setPrecision(PrecisionDouble);
+	_detector.setCrystal(&_snapshot);
+	_finished = false;
+	_cancelled = false;
+	_running = NULL;
+	_newProgress = false;
+	_progress = _snapshot.getRotation();
+
+	LevenbergMarquardtPtr lm = LevenbergMarquardtPtr(new LevenbergMarquardt());
+	lm->setResidualFunction(Detector::residuals, &_detector);
+	lm->addParameter(&_snapshot, Crystal::getHorizontal, Crystal::setHorizontal, 0.002, 0.0002, "horiz");
+	lm->setDerivatives(Detector::horizontalDerivatives);
+	lm->addParameter(&_snapshot, Crystal::getVertical, Crystal::setVertical, 0.002, 0.0002, "vert");
+	lm->setDerivatives(Detector::verticalDerivatives);
+	lm->addParameter(&_snapshot, Crystal::getTwist, Crystal::setTwist, 0.002, 0.0002, "twist");
+	lm->setDerivatives(Detector::twistDerivatives);
+	lm->setCycles(15);
+	_strategy = lm;
+}
+
+void RefinementJob::start()
+{
+	_lastPublish = std::chrono::steady_clock::now();
+	_thread = std::thread(&RefinementJob::run, this);
+}
+
+/* Widens the reach of the least squares, which only finds the nearest
+ * minimum. The scan runs on a copy of the snapshot holding only the
+ * watched reflections, so that each thread can have its own. */
+void RefinementJob::scanOrientation()
+{
+	TRACE_SCOPE("RefinementJob::scanOrientation");
+
+	if (_cancelled || _snapshot.watchedReflections().size() == 0)
+	{
+		return;
+	}
+
+	Crystal scan(_snapshot);
+	scan.setRedrawFunction(NULL, NULL);
+	scan.keepWatchedOnly();
+
+	RefinementGridSearch grid;
+	grid.setEvaluationFunction(Crystal::ewaldSphereClosenessScore, &scan);
+	grid.setCloneFunctions(Crystal::cloneCrystal, Crystal::deleteCrystal);
+	grid.addParameter(&scan, Crystal::getHorizontal, Crystal::setHorizontal, REFINEMENT_SCAN_RANGE, REFINEMENT_SCAN_STEP, "horiz");
+	grid.addParameter(&scan, Crystal::getVertical, Crystal::setVertical, REFINEMENT_SCAN_RANGE, REFINEMENT_SCAN_STEP, "vert");
+	grid.addParameter(&scan, Crystal::getTwist, Crystal::setTwist, REFINEMENT_SCAN_RANGE, REFINEMENT_SCAN_STEP, "twist");
+	grid.setSilent(true);
+	setRunning(&grid);
+	grid.refine();
+	setRunning(NULL);
+
+	Crystal::setHorizontal(&_snapshot, Crystal::getHorizontal(&scan));
+	Crystal::setVertical(&_snapshot, Crystal::getVertical(&scan));
+	Crystal::setTwist(&_snapshot, Crystal::getTwist(&scan));
+}
+
+void RefinementJob::run()
+{
+	TRACE_SCOPE("RefinementJob::run");
+	scanOrientation();
+	setRunning(_strategy.get());
+	_strategy->refine();
+	setRunning(NULL);
+
+	/* Not clearUpRefinement, which would also recheck every reflection
+	 * of the copy for nothing */
+	mat3x3 nudge = _snapshot.getNudge(Crystal::getHorizontal(&_snapshot),
+	                                  Crystal::getVertical(&_snapshot),
+	                                  Crystal::getTwist(&_snapshot));
+	_result = mat3x3_mult_mat3x3(nudge, _snapshot.getRotation());
+	_finished = true;
+}
+
+/* A cancel which arrives between the phases is passed on when the next
+ * one starts, so the least squares never begins after a cancelled scan */
+void RefinementJob::setRunning(RefinementStrategy *strategy)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_running = strategy;
+
+	if (_running && _cancelled)
+	{
+		_running->cancel();
+	}
+}
+
+void RefinementJob::cancel()
+{
+	_cancelled = true;
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_running)
+	{
+		_running->cancel();
+	}
+}
+
+void RefinementJob::publishProgress(void *object)
+{
+	RefinementJob *job = static_cast<RefinementJob *>(object);
+	std::chrono::steady_clock::time_point now;
+	now = std::chrono::steady_clock::now();
+
+	if (now - job->_lastPublish <
+	    std::chrono::milliseconds(REFINEMENT_PUBLISH_MS))
+	{
+		return;
+	}
+
+	job->_lastPublish = now;
+	Crystal *xtal = &job->_snapshot;
+	mat3x3 nudge = xtal->getNudge(Crystal::getHorizontal(xtal),
+	                              Crystal::getVertical(xtal),
+	                              Crystal::getTwist(xtal));
+	mat3x3 rotation = mat3x3_mult_mat3x3(nudge, xtal->getRotation());
+
+	std::lock_guard<std::mutex> lock(job->_mutex);
+	job->_progress = rotation;
+	job->_newProgress = true;
+}
+
+bool RefinementJob::takeProgress(mat3x3 *rotation)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_newProgress)
+	{
+		return false;
+	}
+
+	*rotation = _progress;
+	_newProgress = false;
+
+	return true;
+}
+
+RefinementJob::~RefinementJob()
+{
+	if (_thread.joinable())
+	{
+		cancel();
+		_thread.join();
+	}
+}
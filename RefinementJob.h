@@ -0,0 +1,90 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__RefinementJob__
+#define __Windexing__RefinementJob__
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "Crystal.h"
+#include "Detector.h"
+#include "shared_ptrs.h"
+
+/* Progress is handed to the front end no more often than this */
+#define REFINEMENT_PUBLISH_MS 33
+
+/* Width and spacing, in radians, of the coarse grid scanned over the
+ * three angles before least squares takes over */
+#define REFINEMENT_SCAN_RANGE 0.02
+#define REFINEMENT_SCAN_STEP 0.005
+
+/* Refines the crystal orientation against the watched reflections on a
+ * worker thread, first with a coarse grid scan evaluated in parallel and
+ * then by Levenberg-Marquardt. The worker only touches its own copies of the crystal
+ * and detector; the front end polls for progress and for the finished
+ * result. */
+
+class RefinementJob
+{
+public:
+	RefinementJob(Crystal *crystal, Detector *detector);
+	~RefinementJob();
+
+	void start();
+	void cancel();
+
+	bool isFinished()
+	{
+		return _finished;
+	}
+
+	/* Fills in the latest published rotation if it has changed since the
+	 * last call. */
+	bool takeProgress(mat3x3 *rotation);
+
+	/* Only valid once finished */
+	mat3x3 getResult()
+	{
+		return _result;
+	}
+
+	static void publishProgress(void *job);
+private:
+	void run();
+	void scanOrientation();
+	void setRunning(RefinementStrategy *strategy);
+
+	Crystal _snapshot;
+	Detector _detector;
+	RefinementStrategyPtr _strategy;
+	std::thread _thread;
+	std::atomic<bool> _finished;
+	std::atomic<bool> _cancelled;
+	mat3x3 _result;
+
+	std::mutex _mutex;
+	RefinementStrategy *_running; // whichever phase is refining, if any
+	mat3x3 _progress;
+	bool _newProgress;
+	std::chrono::steady_clock::time_point _lastPublish;
+};
+
+#endif
@@ -0,0 +1,287 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "RefinementLevenbergMarquardt.h"
+#include <math.h>
+#include <algorithm>
+
+double LevenbergMarquardt::sumOfSquares(std::vector<double> &residuals)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < residuals.size(); i++)
+	{
+		sum += residuals[i] * residuals[i];
+	}
+
+	return sum;
+}
+
+double LevenbergMarquardt::residualScore(void *strategy)
+{
+	LevenbergMarquardt *me = static_cast<LevenbergMarquardt *>(strategy);
+	std::vector<double> residuals;
+	(*me->_residualFunction)(me->_residualObject, &residuals);
+
+	return me->sumOfSquares(residuals);
+}
+
+void LevenbergMarquardt::setParameters(std::vector<double> &params)
+{
+	for (size_t i = 0; i < params.size(); i++)
+	{
+		(*setters[i])(objects[i], params[i]);
+	}
+}
+
+/* Expects the parameters to be set to params, and leaves them there with
+ * the residuals at those values freshly evaluated. */
+void LevenbergMarquardt::calculateJacobian(std::vector<double> &params,
+                                           std::vector<double> *residuals,
+                                           std::vector<std::vector<double> > *columns)
+{
+	columns->resize(params.size());
+	bool moved = false;
+
+	for (size_t i = 0; i < params.size(); i++)
+	{
+		if (_derivatives[i] != NULL)
+		{
+			(*_derivatives[i])(_residualObject, &(*columns)[i]);
+		}
+	}
+
+	for (size_t i = 0; i < params.size(); i++)
+	{
+		if (_derivatives[i] != NULL)
+		{
+			continue;
+		}
+
+		std::vector<double> plus, minus;
+		double step = otherValues[i];
+
+		(*setters[i])(objects[i], params[i] + step);
+		(*_residualFunction)(_residualObject, &plus);
+		(*setters[i])(objects[i], params[i] - step);
+		(*_residualFunction)(_residualObject, &minus);
+		(*setters[i])(objects[i], params[i]);
+		moved = true;
+
+		std::vector<double> &column = (*columns)[i];
+		column.resize(plus.size());
+
+		for (size_t j = 0; j < plus.size(); j++)
+		{
+			column[j] = (plus[j] - minus[j]) / (2 * step);
+		}
+	}
+
+	if (moved)
+	{
+		(*_residualFunction)(_residualObject, residuals);
+	}
+}
+
+/* Solves (JtJ + lambda diag(JtJ)) step = -Jt r by Gaussian elimination
+ * with partial pivoting; there are only ever a handful of parameters. */
+bool LevenbergMarquardt::solveStep(std::vector<std::vector<double> > &columns,
+                                   std::vector<double> &residuals,
+                                   double lambda, std::vector<double> *step)
+{
+	size_t n = columns.size();
+	std::vector<double> a(n * (n + 1), 0);
+	double maxDiag = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t j = 0; j <= i; j++)
+		{
+			double sum = 0;
+
+			for (size_t k = 0; k < residuals.size(); k++)
+			{
+				sum += columns[i][k] * columns[j][k];
+			}
+
+			a[i * (n + 1) + j] = sum;
+			a[j * (n + 1) + i] = sum;
+		}
+
+		double gradient = 0;
+
+		for (size_t k = 0; k < residuals.size(); k++)
+		{
+			gradient += columns[i][k] * residuals[k];
+		}
+
+		a[i * (n + 1) + n] = -gradient;
+		maxDiag = std::max(maxDiag, a[i * (n + 1) + i]);
+	}
+
+	if (maxDiag <= 0)
+	{
+		return false;
+	}
+
+	/* Parameters with no effect on the residuals get a token diagonal so
+	 * that they simply stay put */
+	for (size_t i = 0; i < n; i++)
+	{
+		double diag = std::max(a[i * (n + 1) + i], maxDiag * 1e-12);
+		a[i * (n + 1) + i] += lambda * diag;
+	}
+
+	for (size_t col = 0; col < n; col++)
+	{
+		size_t pivot = col;
+
+		for (size_t row = col + 1; row < n; row++)
+		{
+			if (fabs(a[row * (n + 1) + col]) > fabs(a[pivot * (n + 1) + col]))
+			{
+				pivot = row;
+			}
+		}
+
+		if (a[pivot * (n + 1) + col] == 0)
+		{
+			return false;
+		}
+
+		for (size_t k = 0; k <= n; k++)
+		{
+			std::swap(a[col * (n + 1) + k], a[pivot * (n + 1) + k]);
+		}
+
+		for (size_t row = col + 1; row < n; row++)
+		{
+			double factor = a[row * (n + 1) + col] / a[col * (n + 1) + col];
+
+			for (size_t k = col; k <= n; k++)
+			{
+				a[row * (n + 1) + k] -= factor * a[col * (n + 1) + k];
+			}
+		}
+	}
+
+	step->resize(n);
+
+	for (int row = (int)n - 1; row >= 0; row--)
+	{
+		double sum = a[row * (n + 1) + n];
+
+		for (size_t k = row + 1; k < n; k++)
+		{
+			sum -= a[row * (n + 1) + k] * (*step)[k];
+		}
+
+		(*step)[row] = sum / a[row * (n + 1) + row];
+	}
+
+	return true;
+}
+
+void LevenbergMarquardt::refine()
+{
+	_derivatives.resize(objects.size(), NULL);
+
+	if (evaluationFunction == NULL)
+	{
+		setEvaluationFunction(residualScore, this);
+	}
+
+	RefinementStrategy::refine();
+
+	if (tags.size() == 0 || _residualFunction == NULL)
+	{
+		return;
+	}
+
+	std::vector<double> params, residuals;
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		params.push_back((*getters[i])(objects[i]));
+	}
+
+	(*_residualFunction)(_residualObject, &residuals);
+	double score = sumOfSquares(residuals);
+	double lambda = _damping;
+
+	for (int cycle = 0; cycle < maxCycles && !isCancelled(); cycle++)
+	{
+		std::vector<std::vector<double> > columns;
+		calculateJacobian(params, &residuals, &columns);
+
+		bool improved = false;
+		bool converged = false;
+
+		/* Raise the damping until a step goes downhill */
+		for (int attempt = 0; attempt < 10 && !improved; attempt++)
+		{
+			std::vector<double> step, trial;
+
+			if (!solveStep(columns, residuals, lambda, &step))
+			{
+				break;
+			}
+
+			for (size_t i = 0; i < params.size(); i++)
+			{
+				trial.push_back(params[i] + step[i]);
+			}
+
+			setParameters(trial);
+			std::vector<double> trialResiduals;
+			(*_residualFunction)(_residualObject, &trialResiduals);
+			double trialScore = sumOfSquares(trialResiduals);
+
+			if (trialScore < score)
+			{
+				converged = (score - trialScore <= score * 1e-10);
+				params = trial;
+				residuals = trialResiduals;
+				score = trialScore;
+				lambda = std::max(lambda / 10, 1e-12);
+				improved = true;
+			}
+			else
+			{
+				lambda *= 10;
+			}
+		}
+
+		if (!improved)
+		{
+			setParameters(params);
+			(*_residualFunction)(_residualObject, &residuals);
+			break;
+		}
+
+		reportProgress(score);
+
+		if (converged)
+		{
+			break;
+		}
+	}
+
+	finish();
+}
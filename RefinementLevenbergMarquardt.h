@@ -0,0 +1,85 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__LevenbergMarquardt__
+#define __Windexing__LevenbergMarquardt__
+
+#include <stdio.h>
+#include "shared_ptrs.h"
+#include "RefinementStrategy.h"
+
+/* Minimises the sum of squared residuals from a residual function, using
+ * analytic derivatives where they have been supplied with setDerivatives
+ * and central differences (with the otherValue step) where not. */
+
+class LevenbergMarquardt : public RefinementStrategy
+{
+private:
+	Residuals _residualFunction;
+	void *_residualObject;
+	std::vector<Residuals> _derivatives;
+	double _damping;
+
+	double sumOfSquares(std::vector<double> &residuals);
+	void setParameters(std::vector<double> &params);
+	void calculateJacobian(std::vector<double> &params,
+	                       std::vector<double> *residuals,
+	                       std::vector<std::vector<double> > *columns);
+	bool solveStep(std::vector<std::vector<double> > &columns,
+	               std::vector<double> &residuals, double lambda,
+	               std::vector<double> *step);
+public:
+	LevenbergMarquardt() : RefinementStrategy()
+	{
+		_residualFunction = NULL;
+		_residualObject = NULL;
+		_damping = 1e-3;
+		maxCycles = 20;
+	}
+
+	virtual ~LevenbergMarquardt() {};
+
+	/* The derivative functions are called with the same object */
+	void setResidualFunction(Residuals function, void *object)
+	{
+		_residualFunction = function;
+		_residualObject = object;
+	}
+
+	/* Analytic derivatives for the most recently added parameter. These
+	 * are called straight after the residual function at the same values. */
+	void setDerivatives(Residuals function)
+	{
+		_derivatives.resize(objects.size(), NULL);
+		_derivatives.back() = function;
+	}
+
+	/* Evaluation function used unless another is set */
+	static double residualScore(void *strategy);
+
+	virtual void refine();
+
+	virtual void clearParameters()
+	{
+		_derivatives.clear();
+		RefinementStrategy::clearParameters();
+	}
+};
+
+#endif
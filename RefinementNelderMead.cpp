@@ -225,7 +225,7 @@ void NelderMead::refine()
     
     int count = 0;
     
-    while ((!converged() && count < maxCycles))
+    while ((!converged() && count < maxCycles && !isCancelled()))
     {
         std::vector<double> centroid = calculateCentroid();
         count++;
@@ -187,7 +187,7 @@ void RefinementStepSearch::refine()
     
     double bestScore = FLT_MAX;
 
-    for (int i = 0; i < maxCycles; i++)
+    for (int i = 0; i < maxCycles && !isCancelled(); i++)
     {
         bool allFinished = true;
         
@@ -34,6 +34,7 @@
 #include "RefinementGridSearch.h"
 #include "RefinementStepSearch.h"
 #include "RefinementNelderMead.h"
+#include "RefinementLevenbergMarquardt.h"
 #include "RefinementStrategy.h"
 #include "FileReader.h"
 #include <iostream>
@@ -55,6 +56,9 @@ RefinementStrategyPtr RefinementStrategy::userChosenStrategy()
 		case MinimizationMethodGridSearch:
 			strategy = boost::static_pointer_cast<RefinementStrategy>(RefinementGridSearchPtr(new RefinementGridSearch()));
 			break;
+		case MinimizationMethodLevenbergMarquardt:
+			strategy = boost::static_pointer_cast<RefinementStrategy>(LevenbergMarquardtPtr(new LevenbergMarquardt()));
+			break;
         default:
             break;
     }
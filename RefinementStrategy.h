@@ -39,17 +39,22 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <atomic>
 
 typedef enum
 {
 	MinimizationMethodStepSearch = 0,
 	MinimizationMethodNelderMead = 1,
 	MinimizationMethodGridSearch = 2,
+	MinimizationMethodLevenbergMarquardt = 3,
 } MinimizationMethod;
 
 
 typedef double (*Getter)(void *);
 typedef void (*Setter)(void *, double newValue);
+typedef void *(*Cloner)(void *);
+typedef void (*Deleter)(void *);
+typedef void (*Residuals)(void *, std::vector<double> *values);
 
 class RefinementStrategy
 {
@@ -75,6 +80,7 @@ protected:
     std::vector<double> startingValues;
     double startingScore;
 	bool _verbose;
+	std::atomic<bool> _cancelled;
     
     void reportProgress(double score);
     void finish();
@@ -92,6 +98,7 @@ public:
 		finishFunction = NULL;
 		_mock = false;
 		_toDegrees = false;
+		_cancelled = false;
     };
 
     virtual ~RefinementStrategy() {};
@@ -134,6 +141,18 @@ public:
 		return (_changed == 1);
 	}
 
+	/* May be called from another thread; the strategy stops after its
+	 * current cycle and keeps the best parameters found so far. */
+	void cancel()
+	{
+		_cancelled = true;
+	}
+
+	bool isCancelled()
+	{
+		return _cancelled;
+	}
+
 	void isMock()
 	{
 		_mock = true;
@@ -0,0 +1,630 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "ReflectionList.h"
+#include <math.h>
+#include <cmath>
+
+#if defined(__x86_64__)
+#define REFLECTION_LIST_X86
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+ReflectionList::ReflectionList()
+{
+	_precision = PrecisionDouble;
+	_active = 0;
+	_sorted = true;
+}
+
+void ReflectionList::clear()
+{
+	h.clear(); k.clear(); l.clear();
+	x.clear(); y.clear(); z.clear();
+	qSq.clear();
+	posX.clear(); posY.clear(); posZ.clear();
+	weight.clear();
+	excitation.clear();
+	obsX.clear(); obsY.clear();
+	flags.clear();
+	panel.clear();
+	_active = 0;
+	_sorted = true;
+}
+
+void ReflectionList::reserve(size_t count)
+{
+	h.reserve(count); k.reserve(count); l.reserve(count);
+	x.reserve(count); y.reserve(count); z.reserve(count);
+	qSq.reserve(count);
+	posX.reserve(count); posY.reserve(count); posZ.reserve(count);
+	weight.reserve(count);
+	excitation.reserve(count);
+	obsX.reserve(count); obsY.reserve(count);
+	flags.reserve(count);
+	panel.reserve(count);
+}
+
+void ReflectionList::resize(size_t count)
+{
+	h.resize(count); k.resize(count); l.resize(count);
+	x.resize(count); y.resize(count); z.resize(count);
+	qSq.resize(count);
+	posX.resize(count); posY.resize(count); posZ.resize(count);
+	weight.resize(count);
+	excitation.resize(count);
+	obsX.resize(count); obsY.resize(count);
+	flags.resize(count);
+	panel.resize(count);
+	_active = count;
+	_sorted = false;
+}
+
+void ReflectionList::add(int newH, int newK, int newL, vec3 miller)
+{
+	h.push_back(newH);
+	k.push_back(newK);
+	l.push_back(newL);
+	x.push_back(miller.x);
+	y.push_back(miller.y);
+	z.push_back(miller.z);
+	qSq.push_back(vec3_sqlength(miller));
+	posX.push_back(0);
+	posY.push_back(0);
+	posZ.push_back(0);
+	weight.push_back(0);
+	excitation.push_back(0);
+	obsX.push_back(0);
+	obsY.push_back(0);
+	flags.push_back(0);
+	panel.push_back(0);
+	_active = h.size();
+	_sorted = false;
+}
+
+/* Also selects, if order holds fewer entries than values */
+template <typename T>
+static void permute(std::vector<T> &values, std::vector<size_t> &order)
+{
+	std::vector<T> sorted(order.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		sorted[i] = values[order[i]];
+	}
+
+	values.swap(sorted);
+}
+
+void ReflectionList::sortByResolution()
+{
+	if (_sorted)
+	{
+		return;
+	}
+
+	std::vector<std::pair<double, size_t> > keys(storedSize());
+
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		keys[i] = std::make_pair(qSq[i], i);
+	}
+
+	std::sort(keys.begin(), keys.end());
+	std::vector<size_t> order(keys.size());
+
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		order[i] = keys[i].second;
+	}
+
+	permute(h, order); permute(k, order); permute(l, order);
+	permute(x, order); permute(y, order); permute(z, order);
+	permute(qSq, order);
+	permute(posX, order); permute(posY, order); permute(posZ, order);
+	permute(weight, order);
+	permute(excitation, order);
+	permute(obsX, order); permute(obsY, order);
+	permute(flags, order);
+	permute(panel, order);
+	_sorted = true;
+}
+
+void ReflectionList::keep(const std::vector<int> &indices)
+{
+	std::vector<size_t> order(indices.begin(), indices.end());
+
+	permute(h, order); permute(k, order); permute(l, order);
+	permute(x, order); permute(y, order); permute(z, order);
+	permute(qSq, order);
+	permute(posX, order); permute(posY, order); permute(posZ, order);
+	permute(weight, order);
+	permute(excitation, order);
+	permute(obsX, order); permute(obsY, order);
+	permute(flags, order);
+	permute(panel, order);
+	_active = order.size();
+	_sorted = false;
+}
+
+size_t ReflectionList::countWithin(double qSqMax)
+{
+	return std::upper_bound(qSq.begin(), qSq.end(), qSqMax) - qSq.begin();
+}
+
+typedef struct
+{
+	const int *h, *k, *l;
+	double *x, *y, *z;
+	double *weight;
+	unsigned char *flags;
+} ShellArrays;
+
+/* Scalar version, also used for the remainder after the vector loops.
+ * T is the type the arithmetic is done in. The transform is left to
+ * mat3x3_mult_vecs and the shell test reads its output back. */
+template <typename T>
+static void check_shell_scalar(ShellArrays &a, double *matrix, ShellTest &t,
+                               size_t start, size_t end)
+{
+	mat3x3_mult_vecs<T>(matrix, a.h + start, a.k + start, a.l + start,
+	                    end - start, a.x + start, a.y + start, a.z + start);
+
+	const T invWave = t.invWavelength;
+	const T invRlp = t.invRlpSize;
+	const T minSq = t.minLengthSq;
+	const T maxSq = t.maxLengthSq;
+
+	for (size_t i = start; i < end; i++)
+	{
+		T x = a.x[i];
+		T y = a.y[i];
+		T dz = (T)a.z[i] + invWave;
+		T sqLength = x * x + y * y + dz * dz;
+		bool onImage = (sqLength >= minSq && sqLength <= maxSq);
+
+		T size = std::fabs(invWave - std::sqrt(sqLength)) * invRlp;
+		if (size > 1) size = 1;
+
+		a.weight[i] = size;
+		a.flags[i] = (a.flags[i] & ~ReflectionOnImage) |
+		(onImage ? ReflectionOnImage : 0);
+	}
+}
+
+#ifdef REFLECTION_LIST_X86
+
+__attribute__((target("avx2,fma")))
+static void check_shell_avx2(ShellArrays &a, double *m, ShellTest &t,
+                             size_t count)
+{
+	__m256d m0 = _mm256_set1_pd(m[0]), m1 = _mm256_set1_pd(m[1]);
+	__m256d m2 = _mm256_set1_pd(m[2]), m3 = _mm256_set1_pd(m[3]);
+	__m256d m4 = _mm256_set1_pd(m[4]), m5 = _mm256_set1_pd(m[5]);
+	__m256d m6 = _mm256_set1_pd(m[6]), m7 = _mm256_set1_pd(m[7]);
+	__m256d m8 = _mm256_set1_pd(m[8]);
+	__m256d invWave = _mm256_set1_pd(t.invWavelength);
+	__m256d invRlp = _mm256_set1_pd(t.invRlpSize);
+	__m256d minSq = _mm256_set1_pd(t.minLengthSq);
+	__m256d maxSq = _mm256_set1_pd(t.maxLengthSq);
+	__m256d one = _mm256_set1_pd(1.);
+	__m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(~(1LL << 63)));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256d h = _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)&a.h[i]));
+		__m256d k = _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)&a.k[i]));
+		__m256d l = _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)&a.l[i]));
+
+		__m256d x = _mm256_fmadd_pd(m2, l, _mm256_fmadd_pd(m1, k,
+		                                                   _mm256_mul_pd(m0, h)));
+		__m256d y = _mm256_fmadd_pd(m5, l, _mm256_fmadd_pd(m4, k,
+		                                                   _mm256_mul_pd(m3, h)));
+		__m256d z = _mm256_fmadd_pd(m8, l, _mm256_fmadd_pd(m7, k,
+		                                                   _mm256_mul_pd(m6, h)));
+		__m256d dz = _mm256_add_pd(z, invWave);
+		__m256d sq = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(y, y,
+		                                                     _mm256_mul_pd(x, x)));
+
+		__m256d in = _mm256_and_pd(_mm256_cmp_pd(sq, minSq, _CMP_GE_OQ),
+		                           _mm256_cmp_pd(sq, maxSq, _CMP_LE_OQ));
+		int mask = _mm256_movemask_pd(in);
+
+		__m256d size = _mm256_sub_pd(invWave, _mm256_sqrt_pd(sq));
+		size = _mm256_mul_pd(_mm256_and_pd(size, absMask), invRlp);
+		size = _mm256_min_pd(size, one);
+
+		_mm256_storeu_pd(&a.x[i], x);
+		_mm256_storeu_pd(&a.y[i], y);
+		_mm256_storeu_pd(&a.z[i], z);
+		_mm256_storeu_pd(&a.weight[i], size);
+
+		for (int j = 0; j < 4; j++)
+		{
+			a.flags[i + j] = (a.flags[i + j] & ~ReflectionOnImage) |
+			((mask >> j) & ReflectionOnImage);
+		}
+	}
+
+	check_shell_scalar<double>(a, m, t, i, count);
+}
+
+/* SSE2 is always available on x86-64 so needs no target attribute */
+static void check_shell_sse2(ShellArrays &a, double *m, ShellTest &t,
+                             size_t count)
+{
+	__m128d m0 = _mm_set1_pd(m[0]), m1 = _mm_set1_pd(m[1]);
+	__m128d m2 = _mm_set1_pd(m[2]), m3 = _mm_set1_pd(m[3]);
+	__m128d m4 = _mm_set1_pd(m[4]), m5 = _mm_set1_pd(m[5]);
+	__m128d m6 = _mm_set1_pd(m[6]), m7 = _mm_set1_pd(m[7]);
+	__m128d m8 = _mm_set1_pd(m[8]);
+	__m128d invWave = _mm_set1_pd(t.invWavelength);
+	__m128d invRlp = _mm_set1_pd(t.invRlpSize);
+	__m128d minSq = _mm_set1_pd(t.minLengthSq);
+	__m128d maxSq = _mm_set1_pd(t.maxLengthSq);
+	__m128d one = _mm_set1_pd(1.);
+	__m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(~(1LL << 63)));
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128d h = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)&a.h[i]));
+		__m128d k = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)&a.k[i]));
+		__m128d l = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)&a.l[i]));
+
+		__m128d x = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m0, h), _mm_mul_pd(m1, k)),
+		                       _mm_mul_pd(m2, l));
+		__m128d y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m3, h), _mm_mul_pd(m4, k)),
+		                       _mm_mul_pd(m5, l));
+		__m128d z = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m6, h), _mm_mul_pd(m7, k)),
+		                       _mm_mul_pd(m8, l));
+		__m128d dz = _mm_add_pd(z, invWave);
+		__m128d sq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)),
+		                        _mm_mul_pd(dz, dz));
+
+		__m128d in = _mm_and_pd(_mm_cmpge_pd(sq, minSq),
+		                        _mm_cmple_pd(sq, maxSq));
+		int mask = _mm_movemask_pd(in);
+
+		__m128d size = _mm_sub_pd(invWave, _mm_sqrt_pd(sq));
+		size = _mm_mul_pd(_mm_and_pd(size, absMask), invRlp);
+		size = _mm_min_pd(size, one);
+
+		_mm_storeu_pd(&a.x[i], x);
+		_mm_storeu_pd(&a.y[i], y);
+		_mm_storeu_pd(&a.z[i], z);
+		_mm_storeu_pd(&a.weight[i], size);
+
+		for (int j = 0; j < 2; j++)
+		{
+			a.flags[i + j] = (a.flags[i + j] & ~ReflectionOnImage) |
+			((mask >> j) & ReflectionOnImage);
+		}
+	}
+
+	check_shell_scalar<double>(a, m, t, i, count);
+}
+
+/* Single precision versions, with twice as many lanes. The results are
+ * converted to double only to be stored, so only the arithmetic width is
+ * halved; the arrays read and written are the same as above. */
+
+/* Bit 0 of byte j set for each bit j of an 8-bit mask, so that eight
+ * flags can be updated at once */
+static struct MaskTable
+{
+	MaskTable()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			spread[i] = 0;
+
+			for (int j = 0; j < 8; j++)
+			{
+				spread[i] |= (uint64_t)((i >> j) & 1) << (j * 8);
+			}
+		}
+	}
+
+	uint64_t spread[256];
+} mask_table;
+
+static void update_flags8(unsigned char *flags, int mask)
+{
+	const uint64_t bit = 0x0101010101010101ULL * ReflectionOnImage;
+	uint64_t eight;
+	memcpy(&eight, flags, sizeof(eight));
+	eight = (eight & ~bit) | (mask_table.spread[mask] * ReflectionOnImage);
+	memcpy(flags, &eight, sizeof(eight));
+}
+
+__attribute__((target("avx2,fma")))
+static inline void store_ps_as_pd(double *dest, __m256 v)
+{
+	_mm256_storeu_pd(dest, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+	_mm256_storeu_pd(dest + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+static void check_shell_avx2_float(ShellArrays &a, double *m, ShellTest &t,
+                                   size_t count)
+{
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]);
+	__m256 m2 = _mm256_set1_ps(m[2]), m3 = _mm256_set1_ps(m[3]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]);
+	__m256 m6 = _mm256_set1_ps(m[6]), m7 = _mm256_set1_ps(m[7]);
+	__m256 m8 = _mm256_set1_ps(m[8]);
+	__m256 invWave = _mm256_set1_ps(t.invWavelength);
+	__m256 invRlp = _mm256_set1_ps(t.invRlpSize);
+	__m256 minSq = _mm256_set1_ps(t.minLengthSq);
+	__m256 maxSq = _mm256_set1_ps(t.maxLengthSq);
+	__m256 one = _mm256_set1_ps(1.f);
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 h = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i *)&a.h[i]));
+		__m256 k = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i *)&a.k[i]));
+		__m256 l = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i *)&a.l[i]));
+
+		__m256 x = _mm256_fmadd_ps(m2, l, _mm256_fmadd_ps(m1, k,
+		                                                  _mm256_mul_ps(m0, h)));
+		__m256 y = _mm256_fmadd_ps(m5, l, _mm256_fmadd_ps(m4, k,
+		                                                  _mm256_mul_ps(m3, h)));
+		__m256 z = _mm256_fmadd_ps(m8, l, _mm256_fmadd_ps(m7, k,
+		                                                  _mm256_mul_ps(m6, h)));
+		__m256 dz = _mm256_add_ps(z, invWave);
+		__m256 sq = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(y, y,
+		                                                    _mm256_mul_ps(x, x)));
+
+		__m256 in = _mm256_and_ps(_mm256_cmp_ps(sq, minSq, _CMP_GE_OQ),
+		                          _mm256_cmp_ps(sq, maxSq, _CMP_LE_OQ));
+		int mask = _mm256_movemask_ps(in);
+
+		__m256 size = _mm256_sub_ps(invWave, _mm256_sqrt_ps(sq));
+		size = _mm256_mul_ps(_mm256_and_ps(size, absMask), invRlp);
+		size = _mm256_min_ps(size, one);
+
+		store_ps_as_pd(&a.x[i], x);
+		store_ps_as_pd(&a.y[i], y);
+		store_ps_as_pd(&a.z[i], z);
+		store_ps_as_pd(&a.weight[i], size);
+		update_flags8(&a.flags[i], mask);
+	}
+
+	check_shell_scalar<float>(a, m, t, i, count);
+}
+
+static void check_shell_sse2_float(ShellArrays &a, double *m, ShellTest &t,
+                                   size_t count)
+{
+	__m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]);
+	__m128 m2 = _mm_set1_ps(m[2]), m3 = _mm_set1_ps(m[3]);
+	__m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+	__m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]);
+	__m128 m8 = _mm_set1_ps(m[8]);
+	__m128 invWave = _mm_set1_ps(t.invWavelength);
+	__m128 invRlp = _mm_set1_ps(t.invRlpSize);
+	__m128 minSq = _mm_set1_ps(t.minLengthSq);
+	__m128 maxSq = _mm_set1_ps(t.maxLengthSq);
+	__m128 one = _mm_set1_ps(1.f);
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 h = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&a.h[i]));
+		__m128 k = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&a.k[i]));
+		__m128 l = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&a.l[i]));
+
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, h), _mm_mul_ps(m1, k)),
+		                      _mm_mul_ps(m2, l));
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, h), _mm_mul_ps(m4, k)),
+		                      _mm_mul_ps(m5, l));
+		__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, h), _mm_mul_ps(m7, k)),
+		                      _mm_mul_ps(m8, l));
+		__m128 dz = _mm_add_ps(z, invWave);
+		__m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+		                       _mm_mul_ps(dz, dz));
+
+		__m128 in = _mm_and_ps(_mm_cmpge_ps(sq, minSq),
+		                       _mm_cmple_ps(sq, maxSq));
+		int mask = _mm_movemask_ps(in);
+
+		__m128 size = _mm_sub_ps(invWave, _mm_sqrt_ps(sq));
+		size = _mm_mul_ps(_mm_and_ps(size, absMask), invRlp);
+		size = _mm_min_ps(size, one);
+
+		_mm_storeu_pd(&a.x[i], _mm_cvtps_pd(x));
+		_mm_storeu_pd(&a.x[i + 2], _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+		_mm_storeu_pd(&a.y[i], _mm_cvtps_pd(y));
+		_mm_storeu_pd(&a.y[i + 2], _mm_cvtps_pd(_mm_movehl_ps(y, y)));
+		_mm_storeu_pd(&a.z[i], _mm_cvtps_pd(z));
+		_mm_storeu_pd(&a.z[i + 2], _mm_cvtps_pd(_mm_movehl_ps(z, z)));
+		_mm_storeu_pd(&a.weight[i], _mm_cvtps_pd(size));
+		_mm_storeu_pd(&a.weight[i + 2], _mm_cvtps_pd(_mm_movehl_ps(size, size)));
+
+		for (int j = 0; j < 4; j++)
+		{
+			a.flags[i + j] = (a.flags[i + j] & ~ReflectionOnImage) |
+			((mask >> j) & ReflectionOnImage);
+		}
+	}
+
+	check_shell_scalar<float>(a, m, t, i, count);
+}
+
+#endif
+
+void ReflectionList::checkShell(double *matrix, ShellTest &test)
+{
+	size_t count = size();
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	ShellArrays arrays;
+	arrays.h = &h[0]; arrays.k = &k[0]; arrays.l = &l[0];
+	arrays.x = &x[0]; arrays.y = &y[0]; arrays.z = &z[0];
+	arrays.weight = &weight[0];
+	arrays.flags = &flags[0];
+
+#ifdef REFLECTION_LIST_X86
+	static bool avx2 = __builtin_cpu_supports("avx2") &&
+	__builtin_cpu_supports("fma");
+
+	bool single = (_precision == PrecisionSingle);
+
+	if (avx2)
+	{
+		if (single)
+		{
+			check_shell_avx2_float(arrays, matrix, test, count);
+		}
+		else
+		{
+			check_shell_avx2(arrays, matrix, test, count);
+		}
+
+		return;
+	}
+
+	if (single)
+	{
+		check_shell_sse2_float(arrays, matrix, test, count);
+		return;
+	}
+
+	check_shell_sse2(arrays, matrix, test, count);
+#else
+	if (_precision == PrecisionSingle)
+	{
+		check_shell_scalar<float>(arrays, matrix, test, 0, count);
+		return;
+	}
+
+	check_shell_scalar<double>(arrays, matrix, test, 0, count);
+#endif
+}
+
+typedef struct
+{
+	const double *qSq, *z;
+	double *weight;
+	unsigned char *flags;
+} RecheckArrays;
+
+static void recheck_shell_scalar(RecheckArrays &a, ShellTest &t,
+                                 size_t start, size_t end)
+{
+	double twiceInvWave = 2 * t.invWavelength;
+	double invWaveSq = t.invWavelength * t.invWavelength;
+
+	for (size_t i = start; i < end; i++)
+	{
+		double sqLength = a.qSq[i] + twiceInvWave * a.z[i] + invWaveSq;
+		bool onImage = (sqLength >= t.minLengthSq &&
+		                sqLength <= t.maxLengthSq);
+
+		double size = fabs(t.invWavelength - sqrt(sqLength)) * t.invRlpSize;
+		if (size > 1) size = 1;
+
+		a.weight[i] = size;
+		a.flags[i] = (a.flags[i] & ~ReflectionOnImage) |
+		(onImage ? ReflectionOnImage : 0);
+	}
+}
+
+#ifdef REFLECTION_LIST_X86
+
+__attribute__((target("avx2,fma")))
+static void recheck_shell_avx2(RecheckArrays &a, ShellTest &t, size_t count)
+{
+	__m256d twiceInvWave = _mm256_set1_pd(2 * t.invWavelength);
+	__m256d invWaveSq = _mm256_set1_pd(t.invWavelength * t.invWavelength);
+	__m256d invWave = _mm256_set1_pd(t.invWavelength);
+	__m256d invRlp = _mm256_set1_pd(t.invRlpSize);
+	__m256d minSq = _mm256_set1_pd(t.minLengthSq);
+	__m256d maxSq = _mm256_set1_pd(t.maxLengthSq);
+	__m256d one = _mm256_set1_pd(1.);
+	__m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(~(1LL << 63)));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256d qSq = _mm256_loadu_pd(&a.qSq[i]);
+		__m256d z = _mm256_loadu_pd(&a.z[i]);
+		__m256d sq = _mm256_add_pd(_mm256_fmadd_pd(twiceInvWave, z, qSq),
+		                           invWaveSq);
+
+		__m256d in = _mm256_and_pd(_mm256_cmp_pd(sq, minSq, _CMP_GE_OQ),
+		                           _mm256_cmp_pd(sq, maxSq, _CMP_LE_OQ));
+		int mask = _mm256_movemask_pd(in);
+
+		__m256d size = _mm256_sub_pd(invWave, _mm256_sqrt_pd(sq));
+		size = _mm256_mul_pd(_mm256_and_pd(size, absMask), invRlp);
+		size = _mm256_min_pd(size, one);
+
+		_mm256_storeu_pd(&a.weight[i], size);
+
+		for (int j = 0; j < 4; j++)
+		{
+			a.flags[i + j] = (a.flags[i + j] & ~ReflectionOnImage) |
+			((mask >> j) & ReflectionOnImage);
+		}
+	}
+
+	recheck_shell_scalar(a, t, i, count);
+}
+
+#endif
+
+void ReflectionList::recheckShell(ShellTest &test)
+{
+	size_t count = size();
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	RecheckArrays arrays;
+	arrays.qSq = &qSq[0]; arrays.z = &z[0];
+	arrays.weight = &weight[0];
+	arrays.flags = &flags[0];
+
+#ifdef REFLECTION_LIST_X86
+	static bool avx2 = __builtin_cpu_supports("avx2") &&
+	__builtin_cpu_supports("fma");
+
+	if (avx2)
+	{
+		recheck_shell_avx2(arrays, test, count);
+		return;
+	}
+#endif
+
+	recheck_shell_scalar(arrays, test, 0, count);
+}
@@ -0,0 +1,156 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__ReflectionList__
+#define __Windexing__ReflectionList__
+
+#include <vector>
+#include <algorithm>
+#include "vec3.h"
+
+typedef enum
+{
+	ReflectionOnImage = 1, // whether it is to be displayed on overlay
+	ReflectionWatched = 2, // chosen by the user for refinement
+	ReflectionObserved = 4, // has a measured detector position
+} ReflectionFlag;
+
+/* Parameters of the Ewald shell test, in reciprocal Angstroms */
+typedef struct
+{
+	double invWavelength;
+	double invRlpSize;
+	double minLengthSq;
+	double maxLengthSq;
+} ShellTest;
+
+/* Arithmetic precision of the shell and projection kernels. Results are
+ * stored as double either way, so single precision doubles the lanes per
+ * vector but moves as many bytes through memory as double does. It is
+ * only accurate enough for the displayed predictions, not for
+ * refinement. */
+typedef enum
+{
+	PrecisionDouble,
+	PrecisionSingle,
+} KernelPrecision;
+
+/* Reflections stored as separate arrays rather than as an array of
+ * structs, so that transformation of the whole set can be vectorised. */
+
+class ReflectionList
+{
+public:
+	ReflectionList();
+
+	void clear();
+	void reserve(size_t count);
+	void add(int h, int k, int l, vec3 miller);
+
+	/* Makes room for count reflections, all zero, for filling in with
+	 * set() where the order is known in advance */
+	void resize(size_t count);
+
+	void set(size_t i, int newH, int newK, int newL, const vec3 &miller)
+	{
+		h[i] = newH;
+		k[i] = newK;
+		l[i] = newL;
+		x[i] = miller.x;
+		y[i] = miller.y;
+		z[i] = miller.z;
+		qSq[i] = vec3_sqlength(miller);
+	}
+
+	/* Only the first size() reflections are in use; see setActiveCount */
+	size_t size()
+	{
+		return _active;
+	}
+
+	size_t storedSize()
+	{
+		return h.size();
+	}
+
+	/* Limits use to the first count stored reflections, which after
+	 * sortByResolution are those at the lowest resolutions */
+	void setActiveCount(size_t count)
+	{
+		_active = std::min(count, h.size());
+	}
+
+	/* Keeps only the given reflections, in the order given */
+	void keep(const std::vector<int> &indices);
+
+	/* Reorders the stored reflections by increasing |q|, if they have
+	 * been added to since the last time */
+	void sortByResolution();
+
+	bool isSortedByResolution()
+	{
+		return _sorted;
+	}
+
+	/* Number of stored reflections with |q|^2 at most qSqMax, once
+	 * sorted by resolution */
+	size_t countWithin(double qSqMax);
+
+	/* Transforms every reflection by the combined matrix, flags those
+	 * within the shell and calculates their weights. */
+	void checkShell(double *matrix, ShellTest &test);
+
+	/* The same test for a new wavelength or rlp size at the orientation
+	 * of the last transform, from |q - s|^2 = |q|^2 + 2 q.z / lambda +
+	 * 1 / lambda^2 with no transformation needed. */
+	void recheckShell(ShellTest &test);
+
+	void setPrecision(KernelPrecision precision)
+	{
+		_precision = precision;
+	}
+
+	KernelPrecision getPrecision()
+	{
+		return _precision;
+	}
+
+	std::vector<int> h;
+	std::vector<int> k;
+	std::vector<int> l; // before transformation on a integer grid
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> z; // the transformed coordinates in reciprocal space
+	std::vector<double> qSq; // |q|^2, the same in any orientation
+	std::vector<double> posX;
+	std::vector<double> posY;
+	std::vector<double> posZ; // updated by detector when needed
+	std::vector<double> weight; // proportional to closeness to Ewald sphere
+	std::vector<double> excitation; // signed distance from Ewald sphere
+	std::vector<double> obsX;
+	std::vector<double> obsY; // measured position in detector pixels
+	std::vector<unsigned char> flags; // from ReflectionFlag
+	std::vector<short> panel; // detector panel hit, -1 between panels
+private:
+	KernelPrecision _precision;
+	size_t _active;
+	bool _sorted;
+};
+
+#endif
@@ -0,0 +1,294 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "SpotFinder.h"
+#include "Trace.h"
+#include "ImageFrame.h"
+#include "Parallel.h"
+#include <math.h>
+#include <algorithm>
+
+/* Rows per band, so that starting each band's window is a small cost */
+#define SPOT_BAND_MIN_ROWS 64
+
+SpotFinder::SpotFinder(ImageFramePtr frame)
+{
+	_frame = frame;
+	_window = 5;
+	_sigma = 3;
+	_minPixels = 3;
+	_threads = 0;
+}
+
+/* Moves the column sums down by one row: the row leaving the window is
+ * taken away and the row entering it is added. Either may be a blank row
+ * of pixels without data, which count for nothing. */
+static void slide_columns(int32_t *leaving, int32_t *entering, int width,
+                          double *sum, double *sumSq, double *count)
+{
+	for (int x = 0; x < width; x++)
+	{
+		double in = entering[x];
+		double out = leaving[x];
+		double validIn = (entering[x] >= 0);
+		double validOut = (leaving[x] >= 0);
+
+		sum[x] += in * validIn - out * validOut;
+		sumSq[x] += in * in * validIn - out * out * validOut;
+		count[x] += validIn - validOut;
+	}
+}
+
+void SpotFinder::findRuns(int rowStart, int rowEnd,
+                          std::vector<SpotRun> *runs)
+{
+	ImageFrame *frame = _frame.get();
+	int width = frame->width();
+	int r = _window;
+
+	/* Column sums are padded by the window half-width on either side,
+	 * so that windows need no clamping at the edges */
+	int padded = width + 2 * r;
+	std::vector<double> sum(padded, 0), sumSq(padded, 0), count(padded, 0);
+	std::vector<double> prefix(padded + 1, 0), prefixSq(padded + 1, 0);
+	std::vector<double> prefixCount(padded + 1, 0);
+	std::vector<double> excess(width, 0);
+
+	std::vector<int32_t> blank(width, -1);
+	int height = frame->height();
+
+	for (int y = rowStart - r; y <= rowStart + r; y++)
+	{
+		int32_t *entering = (y >= 0 && y < height ? frame->row(y) : &blank[0]);
+		slide_columns(&blank[0], entering, width, &sum[r], &sumSq[r],
+		              &count[r]);
+	}
+
+	for (int y = rowStart; y < rowEnd; y++)
+	{
+		for (int x = 0; x < padded; x++)
+		{
+			prefix[x + 1] = prefix[x] + sum[x];
+			prefixSq[x + 1] = prefixSq[x] + sumSq[x];
+			prefixCount[x + 1] = prefixCount[x] + count[x];
+		}
+
+		int32_t *row = frame->row(y);
+		int across = 2 * r + 1;
+		double sigmaSq = _sigma * _sigma;
+
+		/* Strong pixels, tested with both sides multiplied through by the
+		 * pixel count n to keep divisions out of the loop. Counting
+		 * statistics give a floor to the variance. */
+		for (int x = 0; x < width; x++)
+		{
+			double n = prefixCount[x + across] - prefixCount[x];
+			double total = prefix[x + across] - prefix[x];
+			double totalSq = prefixSq[x + across] - prefixSq[x];
+			double above = n * row[x] - total;
+			double spread = std::max(n * totalSq - total * total,
+			                         std::max(n * total, n * n));
+			/* Arithmetic rather than branches, as these are unpredictable */
+			double strong = ((n > 1) & (row[x] >= 0) & (above > 0) &
+			                 (above * above > sigmaSq * spread));
+			excess[x] = strong * above / std::max(n, 1.);
+		}
+
+		for (int x = 0; x < width; x++)
+		{
+			if (excess[x] <= 0)
+			{
+				continue;
+			}
+
+			SpotRun run;
+			run.y = y;
+			run.start = x;
+			run.sum = 0;
+			run.sumX = 0;
+			run.sumY = 0;
+			run.pixels = 0;
+
+			while (x < width && excess[x] > 0)
+			{
+				run.sum += excess[x];
+				run.sumX += excess[x] * x;
+				run.pixels++;
+				x++;
+			}
+
+			run.end = x - 1;
+			run.sumY = run.sum * y;
+			runs->push_back(run);
+		}
+
+		int out = y - r;
+		int in = y + r + 1;
+		int32_t *leaving = (out >= 0 ? frame->row(out) : &blank[0]);
+		int32_t *entering = (in < height ? frame->row(in) : &blank[0]);
+		slide_columns(leaving, entering, width, &sum[r], &sumSq[r],
+		              &count[r]);
+	}
+}
+
+static int find_root(std::vector<int> &parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+
+	return i;
+}
+
+static void join(std::vector<int> &parent, int a, int b)
+{
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+
+	if (a != b)
+	{
+		parent[std::max(a, b)] = std::min(a, b);
+	}
+}
+
+/* Runs are in order of row, then of column. Runs in neighbouring rows
+ * belong to the same spot if they touch, diagonals included. */
+void SpotFinder::joinRuns(std::vector<SpotRun> &runs)
+{
+	std::vector<int> parent(runs.size());
+
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		parent[i] = i;
+	}
+
+	size_t prevStart = 0;
+	size_t prevEnd = 0;
+	size_t start = 0;
+
+	while (start < runs.size())
+	{
+		size_t end = start;
+
+		while (end < runs.size() && runs[end].y == runs[start].y)
+		{
+			end++;
+		}
+
+		bool adjacent = (prevEnd > prevStart &&
+		                 runs[prevStart].y == runs[start].y - 1);
+		size_t i = prevStart;
+		size_t j = start;
+
+		while (adjacent && i < prevEnd && j < end)
+		{
+			if (runs[i].end + 1 < runs[j].start)
+			{
+				i++;
+				continue;
+			}
+
+			if (runs[j].end + 1 < runs[i].start)
+			{
+				j++;
+				continue;
+			}
+
+			join(parent, i, j);
+
+			if (runs[i].end < runs[j].end)
+			{
+				i++;
+			}
+			else
+			{
+				j++;
+			}
+		}
+
+		prevStart = start;
+		prevEnd = end;
+		start = end;
+	}
+
+	std::vector<int> spotForRoot(runs.size(), -1);
+	std::vector<Spot> spots;
+
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		int root = find_root(parent, i);
+
+		if (spotForRoot[root] < 0)
+		{
+			spotForRoot[root] = spots.size();
+			Spot spot = {0, 0, 0, 0};
+			spots.push_back(spot);
+		}
+
+		Spot &spot = spots[spotForRoot[root]];
+		spot.x += runs[i].sumX;
+		spot.y += runs[i].sumY;
+		spot.intensity += runs[i].sum;
+		spot.pixels += runs[i].pixels;
+	}
+
+	_spots.clear();
+
+	for (size_t i = 0; i < spots.size(); i++)
+	{
+		if (spots[i].pixels < _minPixels || spots[i].intensity <= 0)
+		{
+			continue;
+		}
+
+		spots[i].x /= spots[i].intensity;
+		spots[i].y /= spots[i].intensity;
+		_spots.push_back(spots[i]);
+	}
+}
+
+void SpotFinder::findSpots()
+{
+	TRACE_SCOPE("findSpots");
+	int height = _frame->height();
+	int threads = (_threads > 0 ? _threads : thread_count());
+	int bands = std::max(1, std::min(threads * 4,
+	                                 height / SPOT_BAND_MIN_ROWS));
+	int rowsPerBand = (height + bands - 1) / bands;
+
+	std::vector<std::vector<SpotRun> > bandRuns(bands);
+
+	parallel_for(bands, threads, [&](size_t band, int)
+	{
+		int rowStart = band * rowsPerBand;
+		int rowEnd = std::min(rowStart + rowsPerBand, height);
+		findRuns(rowStart, rowEnd, &bandRuns[band]);
+	});
+
+	std::vector<SpotRun> runs;
+
+	for (int i = 0; i < bands; i++)
+	{
+		runs.insert(runs.end(), bandRuns[i].begin(), bandRuns[i].end());
+	}
+
+	joinRuns(runs);
+}
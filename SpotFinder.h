@@ -0,0 +1,97 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__SpotFinder__
+#define __Windexing__SpotFinder__
+
+#include <vector>
+#include "shared_ptrs.h"
+
+typedef struct
+{
+	double x;
+	double y; // intensity-weighted centroid in pixels
+	double intensity; // summed above the local background
+	int pixels;
+} Spot;
+
+/* Consecutive strong pixels along one row */
+typedef struct
+{
+	int y;
+	int start;
+	int end; // inclusive
+	double sum;
+	double sumX;
+	double sumY;
+	int pixels;
+} SpotRun;
+
+/* Finds spots as connected groups of pixels standing more than a number of
+ * standard deviations above the mean of a square window around them. The
+ * image is split into bands of rows which are searched on separate
+ * threads, each keeping running column sums so that the window statistics
+ * cost the same whatever its size. */
+
+class SpotFinder
+{
+public:
+	SpotFinder(ImageFramePtr frame);
+
+	/* Window is 2 * halfWidth + 1 pixels across */
+	void setWindow(int halfWidth)
+	{
+		_window = halfWidth;
+	}
+
+	void setSigma(double sigma)
+	{
+		_sigma = sigma;
+	}
+
+	void setMinPixels(int pixels)
+	{
+		_minPixels = pixels;
+	}
+
+	/* Zero uses thread_count() */
+	void setThreads(int threads)
+	{
+		_threads = threads;
+	}
+
+	void findSpots();
+
+	std::vector<Spot> &getSpots()
+	{
+		return _spots;
+	}
+private:
+	void findRuns(int rowStart, int rowEnd, std::vector<SpotRun> *runs);
+	void joinRuns(std::vector<SpotRun> &runs);
+
+	ImageFramePtr _frame;
+	int _window;
+	double _sigma;
+	int _minPixels;
+	int _threads;
+	std::vector<Spot> _spots;
+};
+
+#endif
@@ -0,0 +1,177 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "StateFile.h"
+#include "Crystal.h"
+#include "Detector.h"
+#include "FileReader.h"
+#include <fstream>
+#include <vector>
+
+StateFile::StateFile(std::string filename)
+{
+	_filename = filename;
+	_unitCell = false;
+}
+
+bool StateFile::load(Crystal *crystal, Detector *detector)
+{
+	_error = "";
+	_unitCell = false;
+
+	if (!file_exists(_filename))
+	{
+		_error = "Could not find file " + _filename + ".";
+		return false;
+	}
+
+	std::string matrix = get_file_contents(_filename);
+	std::vector<std::string> lines = split(matrix, '\n');
+	bool panels = false;
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		std::vector<std::string> components = split(lines[i], ' ');
+
+		if (components.size() == 0)
+		{
+			continue;
+		}
+
+		if (components[0] == "rotation" || components[0] == "unitcell")
+		{
+			if (components.size() < 10)
+			{
+				_error = "Not enough components, expecting 9 "\
+				         "space-separated values. Try again.";
+				continue;
+			}
+
+			mat3x3 mat = mat3x3_from_string(components);
+
+			if (components[0] == "rotation")
+			{
+				crystal->setRotation(mat);
+			}
+			else
+			{
+				crystal->setUnitCell(mat);
+				_unitCell = true;
+			}
+		}
+
+		if (components[0] == "det_centre")
+		{
+			if (components.size() < 4)
+			{
+				_error = "Not enough components, expecting 3 "\
+				         "space-separated values. Try again.";
+				continue;
+			}
+
+			vec3 centre = vec3_from_string(components);
+			detector->setBeamCentre(centre.x, centre.y);
+			detector->setDetectorDistance(centre.z);
+		}
+
+		if (components[0] == "panel")
+		{
+			if (components.size() < 14)
+			{
+				_error = "Not enough components, expecting 13 "\
+				         "space-separated values. Try again.";
+				continue;
+			}
+
+			/* Panels in this file replace any loaded before */
+			if (!panels)
+			{
+				detector->clearPanels();
+				panels = true;
+			}
+
+			detector->addPanel(panel_from_string(components));
+		}
+
+		if (components[0] == "wavelength" || components[0] == "rlp_size")
+		{
+			if (components.size() < 2)
+			{
+				_error = "Not enough components, expecting 1 "\
+				         "value. Try again.";
+				continue;
+			}
+
+			double value = atof(components[1].c_str());
+
+			if (components[0] == "wavelength")
+			{
+				detector->setWavelength(value);
+				crystal->setWavelength(value);
+			}
+			else
+			{
+				crystal->setRlpSize(value);
+			}
+		}
+	}
+
+	return (_error.length() == 0);
+}
+
+bool StateFile::save(Crystal *crystal, Detector *detector)
+{
+	std::ofstream file;
+	file.open(_filename.c_str());
+
+	if (!file.is_open())
+	{
+		_error = "Could not open " + _filename + " for writing.";
+		return false;
+	}
+
+	mat3x3 rot = crystal->getRotation();
+	mat3x3 unitCell = crystal->getUnitCell();
+	vec3 beamCentre = detector->getBeamCentre();
+
+	file << "rotation ";
+	file << computer_friendly_desc(rot);
+
+	file << "unitcell ";
+	file << computer_friendly_desc(unitCell);
+
+	file << "det_centre ";
+	file << computer_friendly_desc(beamCentre);
+
+	for (size_t i = 0; i < detector->panelCount(); i++)
+	{
+		file << "panel ";
+		file << computer_friendly_desc(detector->getPanel(i));
+	}
+
+	file << "wavelength ";
+	file << detector->getWavelength() << std::endl;
+
+	file << "rlp_size ";
+	file << crystal->getRlpSize() << std::endl;
+
+	file.close();
+
+	return true;
+}
@@ -0,0 +1,59 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__StateFile__
+#define __Windexing__StateFile__
+
+#include <string>
+
+class Crystal;
+class Detector;
+
+/* Reads and writes the .dat state files which hold the crystal rotation,
+ * unit cell and experimental geometry. Used by the GUI and the batch
+ * command, so must not depend on Qt. */
+
+class StateFile
+{
+public:
+	StateFile(std::string filename);
+
+	/* Returns false if any line was malformed; good lines are still
+	 * applied. Does not repopulate the Miller indices. */
+	bool load(Crystal *crystal, Detector *detector);
+	bool save(Crystal *crystal, Detector *detector);
+
+	std::string getError()
+	{
+		return _error;
+	}
+
+	/* Whether the last load found a unit cell line; without one the
+	 * crystal keeps the identity matrix it was made with */
+	bool hasUnitCell()
+	{
+		return _unitCell;
+	}
+private:
+	std::string _filename;
+	std::string _error;
+	bool _unitCell;
+};
+
+#endif
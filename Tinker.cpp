@@ -22,10 +22,21 @@
 #include <QtWidgets/qgraphicsitem.h>
 #include <QtWidgets/qmenubar.h>
 #include <QtWidgets/qmessagebox.h>
+#include <QtWidgets/qstatusbar.h>
+#include <QtGui/qkeysequence.h>
 #include <iostream>
 #include <fstream>
-#include "RefinementNelderMead.h"
+#include <algorithm>
+#include "RefinementJob.h"
 #include "FileReader.h"
+#include "StateFile.h"
+#include "Trace.h"
+#include "ImageFrame.h"
+#include "ImagePyramid.h"
+#include "ImageView.h"
+#include "FrameReader.h"
+#include "SpotFinder.h"
+#include "OrientationSearch.h"
 
 #define DEFAULT_WIDTH 1000
 #define DEFAULT_HEIGHT 800
@@ -41,6 +52,14 @@ Tinker::Tinker(QWidget *parent) : QMainWindow(parent)
 	QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
 	QAction *openAct = fileMenu->addAction(tr("&Open..."));
 	connect(openAct, &QAction::triggered, this, &Tinker::openImage);
+	QAction *seriesAct = fileMenu->addAction(tr("Open se&ries..."));
+	connect(seriesAct, &QAction::triggered, this, &Tinker::openSeries);
+	QAction *nextAct = fileMenu->addAction(tr("&Next frame"));
+	nextAct->setShortcut(QKeySequence(Qt::Key_PageDown));
+	connect(nextAct, &QAction::triggered, this, &Tinker::nextFrame);
+	QAction *prevAct = fileMenu->addAction(tr("&Previous frame"));
+	prevAct->setShortcut(QKeySequence(Qt::Key_PageUp));
+	connect(prevAct, &QAction::triggered, this, &Tinker::previousFrame);
 	QAction *saveAs = fileMenu->addAction(tr("&Save state..."));
 	connect(saveAs, &QAction::triggered, this, &Tinker::saveMatrix);
 	QAction *loadMatrix = fileMenu->addAction(tr("&Load state..."));
@@ -155,6 +174,13 @@ Tinker::Tinker(QWidget *parent) : QMainWindow(parent)
 	connect(bIdentifyHkl, SIGNAL(clicked()), this,
 			SLOT(identifyHkl()));
 
+    bFindSpots = new QPushButton("Find spots", this);
+	bFindSpots->setToolTip("Find spots on the image and search for the "\
+	                       "orientation which explains them");
+	bFindSpots->setGeometry(0, 780, BUTTON_WIDTH, 50);
+	connect(bFindSpots, SIGNAL(clicked()), this,
+			SLOT(findSpotsClicked()));
+
 
 	_refineStage = 0;
 	_fixAxisStage = 0;
@@ -162,17 +188,20 @@ Tinker::Tinker(QWidget *parent) : QMainWindow(parent)
     
 	fileDialogue = NULL;
 
-    imageLabel = new QLabel(this);
-    imageLabel->setScaledContents(true);
-    imageLabel->setGeometry(0, 0, DEFAULT_HEIGHT, DEFAULT_HEIGHT);
-    imageLabel->show();
+    imageView = new ImageView(this);
+    imageView->setGeometry(0, 0, DEFAULT_HEIGHT, DEFAULT_HEIGHT);
+    imageView->show();
 	bUnitCell->show();
 	
 	QBrush brush(Qt::transparent);
 	
-	_crystal.setTinker(this);
+	_refineJob = NULL;
+	_series = new FrameSeries();
+	_series->setDecoder(&Tinker::decodeFrame, NULL);
+	_refineTimer = new QTimer(this);
+	connect(_refineTimer, SIGNAL(timeout()), this, SLOT(checkRefinement()));
 
-	overlayView = new PredictionView(imageLabel);
+	overlayView = new PredictionView(imageView);
 	overlay = new QGraphicsScene(overlayView);
 	overlayView->setCrystal(&_crystal);
 	overlayView->setDetector(&_detector);
@@ -182,11 +211,26 @@ Tinker::Tinker(QWidget *parent) : QMainWindow(parent)
 	overlayView->setStyleSheet("background-color: transparent;");
 	overlayView->setScene(overlay);
 
+	/* Scene items live for the whole session and are only updated */
+	predictionItem = new PredictionItem(&_crystal);
+	overlay->addItem(predictionItem);
+
+	for (int i = 0; i < 3; i++)
+	{
+		basisLines[i] = overlay->addLine(0, 0, 0, 0, QPen(QColor(255, 0, 0)));
+	}
+
+	fixedAxisLine = overlay->addLine(0, 0, 0, 0, QPen(QColor(255, 64, 255)));
+	fixedAxisLine->hide();
+
 	overlayView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	overlayView->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	overlayView->show();
 
 	_detector.setCrystal(&_crystal);
+	/* Predictions on screen only need to be good to a fraction of a pixel */
+	_crystal.reflections()->setPrecision(PrecisionSingle);
+	_crystal.setProgressFunction(&Tinker::enumerationProgress, this);
     
     _notice = new QLabel("Load an image (.png, .jpg, etc.)\n"\
                          "from the file menu.", this);
@@ -211,7 +255,7 @@ void Tinker::resizeEvent(QResizeEvent *)
     
     if (left < BUTTON_WIDTH) left = BUTTON_WIDTH + 10;
 
-    imageLabel->setGeometry(left, top, w, h);
+    imageView->setGeometry(left, top, w, h);
 	overlayView->setGeometry(0, 0, w, h);
 	drawPredictions();
 }
@@ -343,76 +387,65 @@ void Tinker::changeBeamCentre(double deltaX, double deltaY)
 
 void Tinker::transformToDetectorCoordinates(int *x, int *y)
 {
-	double w = blankImage.width();
-	double h = blankImage.height();
-	double winw = overlayView->width();
-	double winh = overlayView->height();
-	
-	std::cout << *x << ", " << *y << " to ";
+	double ix = *x;
+	double iy = *y;
+	imageView->toImage(&ix, &iy);
+
+	TRACE_LOG(TraceDebug, *x << ", " << *y << " to "
+	          << lrint(ix) << ", " << lrint(iy));
 	
-	*x *= w / winw;
-	*y *= h / winh;
+	*x = lrint(ix);
+	*y = lrint(iy);
+}
+
+/* Large cells take long enough to enumerate that the window should say
+ * so. Only the status bar is repainted: running the event loop here
+ * would let timers reach the crystal while its reflections are half
+ * filled in. */
+void Tinker::enumerationProgress(void *object, double fraction)
+{
+	Tinker *me = static_cast<Tinker *>(object);
 
-	std::cout << *x << ", " << *y << std::endl;
+	if (fraction >= 1)
+	{
+		me->statusBar()->clearMessage();
+		return;
+	}
+
+	me->statusBar()->showMessage(QString("Finding reflections... %1%")
+	                             .arg((int)(fraction * 100)));
+	me->statusBar()->repaint();
+}
+
+void Tinker::zoomImage(double x, double y, double factor)
+{
+	imageView->zoomAt(x, y, factor);
+	drawPredictions();
+}
+
+void Tinker::panImage(double dx, double dy)
+{
+	imageView->pan(dx, dy);
+	drawPredictions();
 }
 
 void Tinker::drawPredictions()
 {
+	TRACE_SCOPE("drawPredictions");
 	_detector.calculatePositions();
-	qDeleteAll(overlay->items());
-	overlay->clear();
 	
-	double w = blankImage.width();
-	double h = blankImage.height();
 	double w2 = overlayView->width();
 	double h2 = overlayView->height();
 	double bx = _detector.getBeamCentre().x;
 	double by = _detector.getBeamCentre().y;
+	double scale = imageView->scale();
 	
 	overlay->setSceneRect(overlayView->geometry());
 	
-	bx *= w2 / w;
-	by *= h2 / h;
-	
-	int ellipseSize = 10;
+	imageView->toWidget(&bx, &by);
 	
-	for (size_t i = 0; i < _crystal.millerCount(); i++)
-	{
-		bool onImage = _crystal.shouldDisplayMiller(i);
-
-		if (!onImage)
-		{
-			continue;
-		}
-		
-		double weight = _crystal.weightForMiller(i);
-		if (weight < 0) continue;
-		
-		vec3 pos = _crystal.position(i);
-		
-		QPen pen = QPen(QColor(0, 0, 255, (1 - weight) * 255));
-		bool watching = _crystal.isBeingWatched(i);
-		
-		if (_refineStage != 1) watching = false;
-		
-		QBrush brush(Qt::transparent);
-
-		if (watching)
-		{
-			brush = QBrush(QColor(0, 0, 255, 50));
-		}
-		
-		pos.x = w2 * pos.x / w + bx;
-		pos.y = h2 * pos.y / h + by;
-		
-		if (pos.x < 20 || pos.y < 20 || pos.x > w2 - 20 || pos.y > h2 - 20)
-		{
-			continue;
-		}
-
-		overlay->addEllipse(pos.x - ellipseSize / 2, pos.y - ellipseSize / 2,
-		 					ellipseSize, ellipseSize, pen, brush);	
-	}
+	predictionItem->setShowWatched(_refineStage == 1);
+	predictionItem->setMapping(scale, scale, bx, by, QRectF(0, 0, w2, h2));
 	
 	/* Draw basis vectors for crystal in real space */
 	
@@ -420,12 +453,11 @@ void Tinker::drawPredictions()
 	
 	for (size_t i = 0; i < 3; i++)
 	{
-		QPen pen = QPen(QColor(255, 0, 0));
 		vec3 basis_vector = mat3x3_axis(scaled_basis, i);
 		basis_vector.x += bx;
 		basis_vector.y += by;
 		
-		overlay->addLine(bx, by, basis_vector.x, basis_vector.y, pen);
+		basisLines[i]->setLine(bx, by, basis_vector.x, basis_vector.y);
 	}
 	
 	/* Draw fixed axis, if exists */
@@ -433,10 +465,14 @@ void Tinker::drawPredictions()
 	
 	if (vec3_length(axis) > 0.5) // is set
 	{
-		QPen purple = QPen(QColor(255, 64, 255));
 		vec3_mult(&axis, 100);
-		overlay->addLine(-axis.x + bx, -axis.y + bx,
-						  axis.x + bx, axis.y + bx, purple);
+		fixedAxisLine->setLine(-axis.x + bx, -axis.y + bx,
+		                       axis.x + bx, axis.y + bx);
+		fixedAxisLine->show();
+	}
+	else
+	{
+		fixedAxisLine->hide();
 	}
 }
 
@@ -449,6 +485,13 @@ void Tinker::receiveDialogue(DialogueType type, std::string diagString)
 	{
 		goto cleanup_dialogue;
 	}
+
+	if (type == DialogueSeries)
+	{
+		trim(diagString);
+		loadSeries(diagString);
+		goto cleanup_dialogue;
+	}
 	
 	while (true)
 	{
@@ -518,8 +561,7 @@ void Tinker::receiveDialogue(DialogueType type, std::string diagString)
 		}
 		else
 		{
-			_crystal.setResolution(trial[0]);
-			_crystal.populateMillers();
+			_crystal.applyResolution(trial[0]);
 			drawPredictions();
 		}
 	}
@@ -548,7 +590,7 @@ void Tinker::receiveDialogue(DialogueType type, std::string diagString)
 		else
 		{
 			_detector.setWavelength(trial[0]);
-			_crystal.setWavelength(trial[0]);
+			_crystal.applyWavelength(trial[0]);
 			drawPredictions();
 		}
 	}
@@ -562,8 +604,7 @@ void Tinker::receiveDialogue(DialogueType type, std::string diagString)
 		}
 		else
 		{
-			_crystal.setRlpSize(trial[0]);
-			_crystal.populateMillers();
+			_crystal.applyRlpSize(trial[0]);
 			drawPredictions();
 		}
 	}
@@ -592,11 +633,44 @@ cleanup_dialogue:
 	myDialogue = NULL;
 }
 
+/* Native detector formats keep their counts; anything else Qt can read
+ * is shown and searched as grey levels. Safe to call on any thread. */
+bool Tinker::decodeFrame(void *, std::string filename, SeriesFrame *frame)
+{
+	if (FrameSeries::defaultDecoder(NULL, filename, frame))
+	{
+		return true;
+	}
+
+	QImage image;
+
+	if (!image.load(QString::fromStdString(filename)))
+	{
+		/* A detector format keeps the reason its reader gave */
+		if (!FrameReader::isFrameFile(filename))
+		{
+			frame->error = "Could not read " + filename + " as an image.";
+		}
+
+		return false;
+	}
+
+	image = image.convertToFormat(QImage::Format_Grayscale8);
+	frame->frame = ImageFramePtr();
+	frame->pyramid = ImagePyramidPtr(new ImagePyramid(image.width(),
+	                                                  image.height(),
+	                                                  image.constBits(),
+	                                                  image.bytesPerLine()));
+
+	return true;
+}
+
 void Tinker::openImage()
 {
 	delete fileDialogue;
 	fileDialogue = new QFileDialog(this, tr("Open images"),
-									 tr("Image Files (*.png *.jpg *.tif *.bmp)"));
+									 tr("Image Files (*.png *.jpg *.tif *.bmp"
+									    " *.cbf *.raw)"));
 	fileDialogue->setFileMode(QFileDialog::AnyFile);
 	fileDialogue->show();
 	
@@ -606,36 +680,88 @@ void Tinker::openImage()
     	fileNames = fileDialogue->selectedFiles();
     }
     
-    std::cout << "Read " << fileNames.size() << std::endl;
+    TRACE_LOG(TraceDebug, "Read " << fileNames.size());
     
 	if (fileNames.size() >= 1)
 	{
-		if (!blankImage.load(fileNames[0]))
-		{
-			qDebug("Error loading image");
-			return;
-		}
+		std::string filename = fileNames[0].toStdString();
+		SeriesFrame frame;
 
-		bool first = false;
+		decodeFrame(NULL, filename, &frame);
+		showFrame(frame, filename);
+	}
+}
 
-		if (!imageLabel->pixmap())
-		{
-			first = true;
-		}
+/* Crystal and detector carry over from whatever was shown before */
+void Tinker::showFrame(SeriesFrame frame, std::string filename)
+{
+	if (!frame.pyramid)
+	{
+		TRACE_LOG(TraceWarning, frame.error);
+		return;
+	}
 
-		std::string filename = fileNames[0].toStdString();
-		std::string newTitle = "Mandexing - " + getFilename(filename);
-		
-		this->setWindowTitle(newTitle.c_str());
+	bool first = !imageView->getPyramid();
+	_frame = frame.frame;
 
-		_notice->hide();
-		imageLabel->setPixmap(blankImage);
-		if (first)
-		{
-			_detector.setBeamCentre(blankImage.width() / 2,
-		   	                        blankImage.height() / 2);
-		}
+	std::string newTitle = "Mandexing - " + getFilename(filename);
+	this->setWindowTitle(newTitle.c_str());
+
+	_notice->hide();
+	imageView->setPyramid(frame.pyramid);
+
+	if (first)
+	{
+		_detector.setBeamCentre(frame.pyramid->width() / 2,
+		                        frame.pyramid->height() / 2);
 	}
+
+	drawPredictions();
+}
+
+void Tinker::openSeries()
+{
+	myDialogue = new Dialogue(this, "Open series",
+	                          "Directory, or template with # for digits:",
+	                          "images/frame_#####.cbf",
+	                          "Open series");
+	myDialogue->setTag(DialogueSeries);
+	myDialogue->setTinker(this);
+	myDialogue->show();
+}
+
+void Tinker::loadSeries(std::string path)
+{
+	if (!_series->load(path))
+	{
+		TRACE_LOG(TraceWarning, _series->getError());
+		return;
+	}
+
+	TRACE_LOG(TraceInfo, "Series of " << _series->size() << " frames.");
+	showFrame(_series->frame(0), _series->filename(0));
+}
+
+void Tinker::nextFrame()
+{
+	if (!_series->size())
+	{
+		return;
+	}
+
+	SeriesFrame frame = _series->next();
+	showFrame(frame, _series->filename(_series->index()));
+}
+
+void Tinker::previousFrame()
+{
+	if (!_series->size())
+	{
+		return;
+	}
+
+	SeriesFrame frame = _series->previous();
+	showFrame(frame, _series->filename(_series->index()));
 }
 
 void Tinker::loadMatrix()
@@ -655,97 +781,23 @@ void Tinker::loadMatrix()
     if (fileNames.size() >= 1)
 	{
 		std::string filename = fileNames[0].toStdString();
-		std::string matrix = get_file_contents(filename);
-		
-		std::vector<std::string> lines = split(matrix, '\n');
-		
-		QMessageBox *msgBox = new QMessageBox(this);
-		msgBox->setStandardButtons(QMessageBox::Ok);
-		msgBox->setDefaultButton(QMessageBox::Ok);
-		msgBox->setWindowModality(Qt::NonModal);
-		msgBox->setText("Sorry no");
-		
-		for (size_t i = 0; i < lines.size(); i++)
+		StateFile state = StateFile(filename);
+		overlayView->flushRotation();
+
+		if (!state.load(&_crystal, &_detector))
 		{
-			std::vector<std::string> components = split(lines[i], ' ');
-			
-			if (components.size() == 0)
-			{
-				continue;
-			}
-
-			if (components[0] == "rotation" || components[0] == "unitcell")
-			{
-				if (components.size() < 10)
-				{
-					msgBox->setInformativeText("Not enough components,"\
-					                           "expecting 9 space-separated "\
-					                           "values. Try again.");
-					msgBox->exec();
-				}
-			}
-
-			if (components[0] == "rotation")
-			{
-				mat3x3 rotMat = mat3x3_from_string(components);
-				_crystal.setRotation(rotMat);
-			}
-
-			if (components[0] == "unitcell")
-			{
-				mat3x3 unitCell = mat3x3_from_string(components);
-				_crystal.setUnitCell(unitCell);
-			}
-
-			if (components[0] == "det_centre")
-			{
-				if (components.size() < 4)
-				{
-					msgBox->setInformativeText("Not enough components,"\
-					                           "expecting 3 space-separated "\
-					                           "values. Try again.");
-					msgBox->exec();
-				}
-
-				vec3 centre = vec3_from_string(components);
-				_detector.setBeamCentre(centre.x, centre.y);
-				_detector.setDetectorDistance(centre.z);
-			}
-			
-			if (components[0] == "wavelength")
-			{
-				if (components.size() < 2)
-				{
-					msgBox->setInformativeText("Not enough components,"\
-					                           "expecting 1 "\
-					                           "value. Try again.");
-					msgBox->exec();
-				}
-
-				double wave = atof(components[1].c_str());
-				_detector.setWavelength(wave);
-				_crystal.setWavelength(wave);
-			}
-			
-			if (components[0] == "rlp_size")
-			{
-				if (components.size() < 2)
-				{
-					msgBox->setInformativeText("Not enough components,"\
-					                           "expecting 1 "\
-					                           "value. Try again.");
-					msgBox->exec();
-				}
-
-				double rlp_size = atof(components[1].c_str());
-				_crystal.setRlpSize(rlp_size);
-			}
+			QMessageBox *msgBox = new QMessageBox(this);
+			msgBox->setStandardButtons(QMessageBox::Ok);
+			msgBox->setDefaultButton(QMessageBox::Ok);
+			msgBox->setWindowModality(Qt::NonModal);
+			msgBox->setText("Sorry no");
+			msgBox->setInformativeText(state.getError().c_str());
+			msgBox->exec();
+			delete msgBox;
 		}
 
 		_crystal.populateMillers();
 		drawPredictions();
-		
-		delete msgBox;
 	}
 }
     
@@ -766,29 +818,13 @@ void Tinker::saveMatrix()
     
     if (fileNames.size() >= 1)
 	{
-		std::ofstream file;
-		file.open(fileNames[0].toStdString().c_str());
+		StateFile state = StateFile(fileNames[0].toStdString());
+		overlayView->flushRotation();
 		
-		mat3x3 rot = _crystal.getRotation();
-		mat3x3 unitCell = _crystal.getUnitCell();
-		vec3 beamCentre = _detector.getBeamCentre();
-		
-		file << "rotation ";
-		file << computer_friendly_desc(rot);
-		
-		file << "unitcell ";
-		file << computer_friendly_desc(unitCell);
-		
-		file << "det_centre ";
-		file << computer_friendly_desc(beamCentre);
-		
-		file << "wavelength ";
-		file << _detector.getWavelength() << std::endl;
-
-		file << "rlp_size ";
-		file << _crystal.getRlpSize() << std::endl;
-
-		file.close();
+		if (!state.save(&_crystal, &_detector))
+		{
+			qDebug("%s", state.getError().c_str());
+		}
 	}
 }
 
@@ -825,24 +861,58 @@ void Tinker::changeLattice(BravaisLatticeType type)
 void Tinker::startRefinement()
 {
 	_refineStage = 2;
-	bRefine->setText("Refining...");
-	
-	NelderMeadPtr mead = NelderMeadPtr(new NelderMead());
-	mead->setEvaluationFunction(Crystal::ewaldSphereClosenessScore, &_crystal);
-	mead->addParameter(&_crystal, Crystal::getHorizontal, Crystal::setHorizontal, 0.002, 0.0002);
-	mead->addParameter(&_crystal, Crystal::getVertical, Crystal::setVertical, 0.002, 0.0002);
-	mead->setCycles(15);
-	mead->refine();
-	
-	_crystal.clearUpRefinement();
-	_refineStage = 0;
-	bRefine->setText("Refine");
+	bRefine->setText("Refining... (cancel)");
+	overlayView->setEnabled(false);
 	
-//	QtConcurrent::run(RefinementStrategy::run, &*mead);
+	/* The job works on its own copy of the crystal */
+	overlayView->flushRotation();
+	delete _refineJob;
+	_refineJob = new RefinementJob(&_crystal, &_detector);
+	_refineJob->start();
+	_refineTimer->start(REFINEMENT_PUBLISH_MS);
+}
+
+void Tinker::checkRefinement()
+{
+	if (!_refineJob)
+	{
+		_refineTimer->stop();
+		return;
+	}
+
+	mat3x3 rotation;
+
+	if (_refineJob->isFinished())
+	{
+		_refineTimer->stop();
+		_crystal.turnTo(_refineJob->getResult());
+		delete _refineJob;
+		_refineJob = NULL;
+
+		_crystal.clearUpRefinement();
+		drawPredictions();
+
+		_refineStage = 0;
+		bRefine->setText("Refine");
+		overlayView->setEnabled(true);
+		overlayView->setFocus();
+	}
+	else if (_refineJob->takeProgress(&rotation))
+	{
+		_crystal.turnTo(rotation);
+		_crystal.quickCheckMillers();
+		drawPredictions();
+	}
 }
 
 void Tinker::refineClicked()
 {
+	if (_refineStage == 2)
+	{
+		_refineJob->cancel();
+		return;
+	}
+
 	if (_refineStage == 0)
 	{
 		_detector.prepareLookupTable();
@@ -853,12 +923,57 @@ void Tinker::refineClicked()
 	else
 	{
 		bRefine->setText("Refine");
-		overlayView->setRefineStage(0);
 		_refineStage = 0;		
+		overlayView->setRefineStage(0);
 	}
 }
 
 
+void Tinker::findSpotsClicked()
+{
+	ImagePyramidPtr pyramid = imageView->getPyramid();
+
+	if (!pyramid)
+	{
+		return;
+	}
+
+	/* Native detector frames keep their counts; other images are searched
+	 * on their grey levels. */
+	ImageFramePtr frame = _frame;
+
+	if (!frame)
+	{
+		frame = ImageFramePtr(new ImageFrame(pyramid->width(),
+		                                     pyramid->height()));
+		const unsigned char *grey = pyramid->level(0);
+		size_t count = (size_t)pyramid->width() * pyramid->height();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			frame->data()[i] = grey[i];
+		}
+	}
+
+	SpotFinder finder = SpotFinder(frame);
+	finder.findSpots();
+	std::vector<Spot> &spots = finder.getSpots();
+	TRACE_LOG(TraceInfo, "Found " << spots.size() << " spots.");
+
+	OrientationSearch search = OrientationSearch(&_crystal, &_detector);
+
+	for (size_t i = 0; i < spots.size(); i++)
+	{
+		search.addSpot(spots[i].x, spots[i].y);
+	}
+
+	if (search.search())
+	{
+		_crystal.populateMillers();
+		drawPredictions();
+	}
+}
+
 void Tinker::identifyHkl()
 {
     if (_identifyHklStage == 0)
@@ -879,6 +994,8 @@ void Tinker::identifyHkl()
 
 Tinker::~Tinker()
 {
+	delete _refineJob;
+	delete _series;
 	delete bUnitCell;
-	delete imageLabel;
+	delete imageView;
 }
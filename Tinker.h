@@ -33,9 +33,15 @@
 #include <QtWidgets/qfiledialog.h>
 #include <QtWidgets/qgraphicsview.h>
 #include "Crystal.h"
+#include "FrameSeries.h"
 #include "PredictionView.h"
+#include "PredictionItem.h"
 #include <vector>
 #include <QtCore/qsignalmapper.h>
+#include <QtCore/qtimer.h>
+
+class RefinementJob;
+class ImageView;
 
 class Tinker : public QMainWindow
 {
@@ -54,6 +60,7 @@ public:
     QPushButton *bRlpSize;
     QPushButton *bRefine;
 	QPushButton *bIdentifyHkl;
+	QPushButton *bFindSpots;
     QPushButton *bDegrees;
     QPushButton *bResolution;
     QPushButton *bLatPrimitive, *bLatBody, *bLatFace, *bLatBase;
@@ -64,10 +71,13 @@ public:
     QPushButton *bBeamYPlus, *bBeamYMinus;
     
     /* Image display */
-    QPixmap blankImage;
+    ImageView *imageView;
+    ImageFramePtr _frame;
     QGraphicsScene *overlay;
     PredictionView *overlayView;
-    QLabel *imageLabel;
+    PredictionItem *predictionItem;
+    QGraphicsLineItem *basisLines[3];
+    QGraphicsLineItem *fixedAxisLine;
     
     Dialogue *myDialogue;
 	QFileDialog *fileDialogue;
@@ -78,9 +88,10 @@ public:
 	void drawPredictions();
 	void finishFixAxis();
 	void transformToDetectorCoordinates(int *x, int *y);
+	void zoomImage(double x, double y, double factor);
+	void panImage(double dx, double dy);
 	void startRefinement();
 
-
     ~Tinker();
 protected:
     virtual void resizeEvent(QResizeEvent *event);
@@ -117,22 +128,35 @@ private slots:
     /* Menu slots */
     
     void openImage();
+    void openSeries();
+    void nextFrame();
+    void previousFrame();
     void saveMatrix();
     void loadMatrix();
     
     /* Process */
 	
 	void refineClicked();
+	void checkRefinement();
+	void findSpotsClicked();
 	
 
 private:
 	void changeBeamCentre(double deltaX, double deltaY);
+	void showFrame(SeriesFrame frame, std::string filename);
+	void loadSeries(std::string path);
+	static bool decodeFrame(void *object, std::string filename,
+	                        SeriesFrame *frame);
+	static void enumerationProgress(void *object, double fraction);
 	QLabel *_notice;
 	
 	
 	std::vector<double> _unitCell;
 	Crystal _crystal;
 	Detector _detector;
+	RefinementJob *_refineJob;
+	FrameSeries *_series;
+	QTimer *_refineTimer;
 
 	int _identifyHklStage;
 	int _fixAxisStage;
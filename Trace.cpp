@@ -0,0 +1,227 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#include "Trace.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stdlib.h>
+#include "boost/shared_ptr.hpp"
+#include "FileReader.h"
+
+#define TRACE_BUFFER_EVENTS 65536
+
+std::atomic<int> trace_log_level(TraceInfo);
+std::atomic<bool> trace_recording(false);
+
+typedef struct
+{
+	const char *name;
+	int64_t start;
+	int64_t end;
+} TraceEvent;
+
+/* Written only by the thread holding it; also held in the list below, so
+ * that its events can be exported after the thread has finished */
+typedef struct
+{
+	int thread;
+	std::atomic<size_t> count;
+	std::vector<TraceEvent> events;
+} TraceBuffer;
+
+typedef boost::shared_ptr<TraceBuffer> TraceBufferPtr;
+
+static std::mutex trace_mutex;
+static std::vector<TraceBufferPtr> trace_buffers;
+static std::vector<TraceBufferPtr> trace_free_buffers;
+static std::string trace_file;
+static const std::chrono::steady_clock::time_point trace_epoch =
+std::chrono::steady_clock::now();
+
+static void trace_export_at_exit()
+{
+	trace_stop();
+
+	if (!trace_export(trace_file))
+	{
+		std::cerr << "Could not write trace to " << trace_file << std::endl;
+	}
+}
+
+/* Reads the environment before main() */
+static bool trace_configure()
+{
+	const char *level = getenv("MANDEXING_LOG");
+
+	if (level)
+	{
+		std::string name = level;
+		to_lower(name);
+
+		if (name == "error" || name == "0") trace_set_level(TraceError);
+		else if (name == "warning" || name == "1") trace_set_level(TraceWarning);
+		else if (name == "info" || name == "2") trace_set_level(TraceInfo);
+		else if (name == "debug" || name == "3") trace_set_level(TraceDebug);
+	}
+
+	const char *file = getenv("MANDEXING_TRACE");
+
+	if (file && file[0] != '\0')
+	{
+		trace_file = file;
+		trace_start();
+		atexit(trace_export_at_exit);
+	}
+
+	return true;
+}
+
+static bool trace_configured = trace_configure();
+
+void trace_set_level(TraceLevel level)
+{
+	trace_log_level.store(level, std::memory_order_relaxed);
+}
+
+void trace_write(TraceLevel level, std::string message)
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	std::ostream &out = (level <= TraceWarning ? std::cerr : std::cout);
+	out << message << '\n';
+}
+
+int64_t trace_now()
+{
+	std::chrono::nanoseconds elapsed;
+	elapsed = std::chrono::steady_clock::now() - trace_epoch;
+	return elapsed.count();
+}
+
+void trace_start()
+{
+	trace_recording.store(true, std::memory_order_relaxed);
+}
+
+void trace_stop()
+{
+	trace_recording.store(false, std::memory_order_relaxed);
+}
+
+/* Hands the buffer back when its thread finishes, so that the next new
+ * thread carries on writing into it under the same tid rather than
+ * allocating another. Threads which come and go, such as those of
+ * RefinementJob, then need no more buffers than ever ran at once. */
+class TraceLocalBuffer
+{
+public:
+	~TraceLocalBuffer()
+	{
+		if (buffer)
+		{
+			std::lock_guard<std::mutex> lock(trace_mutex);
+			trace_free_buffers.push_back(buffer);
+		}
+	}
+
+	TraceBufferPtr buffer;
+};
+
+static TraceBuffer *trace_local_buffer()
+{
+	thread_local TraceLocalBuffer local;
+
+	if (!local.buffer)
+	{
+		std::lock_guard<std::mutex> lock(trace_mutex);
+
+		if (trace_free_buffers.size())
+		{
+			local.buffer = trace_free_buffers.back();
+			trace_free_buffers.pop_back();
+			return local.buffer.get();
+		}
+
+		local.buffer = TraceBufferPtr(new TraceBuffer());
+		local.buffer->count = 0;
+		local.buffer->events.resize(TRACE_BUFFER_EVENTS);
+		local.buffer->thread = trace_buffers.size() + 1;
+		trace_buffers.push_back(local.buffer);
+	}
+
+	return local.buffer.get();
+}
+
+void trace_record(const char *name, int64_t start, int64_t end)
+{
+	TraceBuffer *buffer = trace_local_buffer();
+	size_t n = buffer->count.load(std::memory_order_relaxed);
+	TraceEvent &event = buffer->events[n % TRACE_BUFFER_EVENTS];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+bool trace_export(std::string filename)
+{
+	std::ofstream file(filename.c_str());
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	bool first = true;
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\": [" << std::endl;
+
+	for (size_t i = 0; i < trace_buffers.size(); i++)
+	{
+		TraceBuffer *buffer = trace_buffers[i].get();
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		size_t start = 0;
+
+		if (count > TRACE_BUFFER_EVENTS)
+		{
+			start = count - TRACE_BUFFER_EVENTS;
+		}
+
+		for (size_t j = start; j < count; j++)
+		{
+			TraceEvent &event = buffer->events[j % TRACE_BUFFER_EVENTS];
+
+			/* Times are in microseconds */
+			file << (first ? "" : ",\n")
+			<< "{\"name\": \"" << event.name << "\", \"ph\": \"X\", "
+			<< "\"pid\": 1, \"tid\": " << buffer->thread << ", "
+			<< "\"ts\": " << event.start / 1000. << ", "
+			<< "\"dur\": " << (event.end - event.start) / 1000. << "}";
+			first = false;
+		}
+	}
+
+	file << std::endl << "]}" << std::endl;
+
+	return true;
+}
@@ -0,0 +1,116 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+#ifndef __Windexing__Trace__
+#define __Windexing__Trace__
+
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <stdint.h>
+
+/* Levelled logging and scoped timers. Both cost one relaxed atomic load
+ * when switched off, so they may sit in the hot loops.
+ *
+ * MANDEXING_LOG=error|warning|info|debug sets the log level (default
+ * info). MANDEXING_TRACE=<file> records every timed scope and writes
+ * them as Chrome trace events (chrome://tracing, Perfetto) on exit. */
+
+typedef enum
+{
+	TraceError = 0,
+	TraceWarning = 1,
+	TraceInfo = 2,
+	TraceDebug = 3,
+} TraceLevel;
+
+extern std::atomic<int> trace_log_level;
+extern std::atomic<bool> trace_recording;
+
+inline bool trace_enabled(TraceLevel level)
+{
+	return (level <= trace_log_level.load(std::memory_order_relaxed));
+}
+
+void trace_set_level(TraceLevel level);
+
+/* Writes one line to standard output, whole even between threads */
+void trace_write(TraceLevel level, std::string message);
+
+/* message may be anything which can be streamed, such as
+ * "Found " << count << " spots." and is only built if it will be shown */
+#define TRACE_LOG(level, message) \
+do \
+{ \
+	if (trace_enabled(level)) \
+	{ \
+		std::ostringstream _trace_stream; \
+		_trace_stream << message; \
+		trace_write(level, _trace_stream.str()); \
+	} \
+} while (0)
+
+/* Nanoseconds since the program started */
+int64_t trace_now();
+
+/* Starts or stops recording scopes. Events go into a ring buffer per
+ * thread, so the oldest are overwritten in long sessions. */
+void trace_start();
+void trace_stop();
+
+/* Writes the recorded events as Chrome trace-event JSON. Scopes still
+ * being recorded on other threads may be missing. */
+bool trace_export(std::string filename);
+
+void trace_record(const char *name, int64_t start, int64_t end);
+
+/* Records the time from construction to destruction under a name which
+ * must outlive the program, such as a string literal */
+class TraceScope
+{
+public:
+	TraceScope(const char *name)
+	{
+		_name = NULL;
+		_start = 0;
+
+		if (trace_recording.load(std::memory_order_relaxed))
+		{
+			_name = name;
+			_start = trace_now();
+		}
+	}
+
+	~TraceScope()
+	{
+		if (_name)
+		{
+			trace_record(_name, _start, trace_now());
+		}
+	}
+private:
+	const char *_name;
+	int64_t _start;
+};
+
+#define TRACE_JOIN_INNER(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(_trace_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,428 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+
+
+/* mandexing-batch: predicts reflections for a list of frames from a saved
+ * state file without starting the GUI. */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include "Crystal.h"
+#include "Detector.h"
+#include "StateFile.h"
+#include "OrientationSearch.h"
+#include "FrameReader.h"
+#include "SpotFinder.h"
+#include "ImageFrame.h"
+#include "FileReader.h"
+#include "RefinementLevenbergMarquardt.h"
+#include "defaults.h"
+
+/* Fewer matched spots than this leave the geometry as it was */
+#define GEOMETRY_MIN_SPOTS 10
+
+void usage()
+{
+	std::cout << "Usage: mandexing-batch [options] state.dat "\
+	"frame [frame ...]" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Writes <frame>_predictions.csv next to each frame. If a file "\
+	"<frame>.dat sits next to the frame, it is loaded over the top of "\
+	"state.dat for that frame only." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  -l <file>    read further frame names, one per line"
+	<< std::endl;
+	std::cout << "  -o <dir>     write output files into this directory instead"
+	<< std::endl;
+	std::cout << "  -r <res>     maximum resolution in Å (default "
+	<< STARTING_RESOLUTION << ")" << std::endl;
+	std::cout << "  -b <P|I|F|C> Bravais lattice centring (default P)"
+	<< std::endl;
+	std::cout << "  -s           search for the orientation using the spot "\
+	"positions in <frame>_spots.csv, saving it to <frame>_indexed.dat; "\
+	"without a spot file, CBF and raw frames are searched for spots"
+	<< std::endl;
+	std::cout << "  -g           with -s, also refine the beam centre, "\
+	"detector distance and wavelength against the spots" << std::endl;
+}
+
+bool latticeFromString(std::string str, BravaisLatticeType *type)
+{
+	to_upper(str);
+
+	if (str == "P") *type = BravaisLatticePrimitive;
+	else if (str == "I") *type = BravaisLatticeBody;
+	else if (str == "F") *type = BravaisLatticeFace;
+	else if (str == "C") *type = BravaisLatticeBase;
+	else return false;
+
+	return true;
+}
+
+std::string frameStateFile(std::string frame)
+{
+	size_t pos = frame.rfind(".");
+	size_t slash = frame.rfind("/");
+
+	if (pos == std::string::npos || (slash != std::string::npos &&
+	                                 pos < slash))
+	{
+		return frame + ".dat";
+	}
+
+	return frame.substr(0, pos) + ".dat";
+}
+
+std::string frameSpotFile(std::string frame)
+{
+	std::string state = frameStateFile(frame);
+	return state.substr(0, state.length() - 4) + "_spots.csv";
+}
+
+/* Next to the frame, unless -o gave a directory */
+std::string frameOutputFile(std::string frame, std::string suffix)
+{
+	if (FileReader::hasOutputDirectory())
+	{
+		return FileReader::addOutputDirectory(getBaseFilename(frame) + suffix);
+	}
+
+	std::string state = frameStateFile(frame);
+	return state.substr(0, state.length() - 4) + suffix;
+}
+
+/* Spot file has x and y in pixels as its first two columns; lines which
+ * do not start with a number, such as a header, are skipped. */
+void readSpotFile(std::string spotFile, OrientationSearch *search)
+{
+	std::string contents = get_file_contents(spotFile);
+	std::vector<std::string> lines = split(contents, '\n');
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		std::vector<std::string> fields = split(lines[i], ',');
+
+		if (fields.size() < 2)
+		{
+			continue;
+		}
+
+		char *end = NULL;
+		double x = strtod(fields[0].c_str(), &end);
+
+		if (end == fields[0].c_str())
+		{
+			continue;
+		}
+
+		search->addSpot(x, atof(fields[1].c_str()));
+	}
+}
+
+/* Refines the orientation together with the beam centre, detector
+ * distance and wavelength, from the spots lying close to a prediction */
+void refineGeometry(std::string frame, Crystal *crystal, Detector *detector,
+                    std::vector<vec2> &spots)
+{
+	crystal->populateMillers();
+	int observed = detector->observeSpots(spots);
+
+	if (observed < GEOMETRY_MIN_SPOTS)
+	{
+		std::cout << frame << ": only " << observed << " spots near a "\
+		"prediction, keeping the geometry." << std::endl;
+		crystal->clearUpRefinement();
+		return;
+	}
+
+	LevenbergMarquardt lm;
+	lm.setResidualFunction(Detector::residuals, detector);
+	lm.addParameter(crystal, Crystal::getHorizontal, Crystal::setHorizontal, 0.002, 0.0002, "horiz");
+	lm.setDerivatives(Detector::horizontalDerivatives);
+	lm.addParameter(crystal, Crystal::getVertical, Crystal::setVertical, 0.002, 0.0002, "vert");
+	lm.setDerivatives(Detector::verticalDerivatives);
+	lm.addParameter(crystal, Crystal::getTwist, Crystal::setTwist, 0.002, 0.0002, "twist");
+	lm.setDerivatives(Detector::twistDerivatives);
+	lm.addParameter(detector, Detector::getBeamX, Detector::setBeamX, 1, 0.1, "beam_x");
+	lm.setDerivatives(Detector::beamXDerivatives);
+	lm.addParameter(detector, Detector::getBeamY, Detector::setBeamY, 1, 0.1, "beam_y");
+	lm.setDerivatives(Detector::beamYDerivatives);
+	lm.addParameter(detector, Detector::getDistance, Detector::setDistance, 10, 1, "distance");
+	lm.setDerivatives(Detector::distanceDerivatives);
+	lm.addParameter(detector, Detector::getSharedWavelength, Detector::setSharedWavelength, 0.001, 0.0001, "wavelength");
+	lm.setDerivatives(Detector::wavelengthDerivatives);
+	lm.setCycles(30);
+	lm.setSilent(true);
+	lm.refine();
+
+	crystal->clearUpRefinement();
+	vec3 centre = detector->getBeamCentre();
+
+	std::cout << frame << ": geometry refined against " << observed
+	<< " spots, beam centre " << centre.x << " " << centre.y
+	<< ", distance " << centre.z << ", wavelength "
+	<< detector->getWavelength() << std::endl;
+}
+
+/* Uses the spot file if there is one, otherwise finds spots on the frame
+ * itself if it is in a format FrameReader understands. */
+bool searchOrientation(std::string frame, Crystal *crystal,
+                       Detector *detector, bool geometry)
+{
+	std::string spotFile = frameSpotFile(frame);
+	OrientationSearch search(crystal, detector);
+
+	if (!file_exists(spotFile))
+	{
+		std::string error;
+		ImageFramePtr image = FrameReader::readFrame(frame, &error);
+
+		if (!image)
+		{
+			std::cout << frame << ": no spot file " << spotFile
+			<< " and " << error << std::endl;
+			return false;
+		}
+
+		SpotFinder finder = SpotFinder(image);
+		finder.findSpots();
+		std::vector<Spot> &spots = finder.getSpots();
+
+		for (size_t i = 0; i < spots.size(); i++)
+		{
+			search.addSpot(spots[i].x, spots[i].y);
+		}
+	}
+	else
+	{
+		readSpotFile(spotFile, &search);
+	}
+
+	if (!search.search())
+	{
+		std::cout << frame << ": orientation search found nothing from "
+		<< search.spotCount() << " spots." << std::endl;
+		return false;
+	}
+
+	if (geometry)
+	{
+		refineGeometry(frame, crystal, detector, search.getSpots());
+	}
+
+	std::string path = frameOutputFile(frame, "_indexed.dat");
+	StateFile state = StateFile(path);
+
+	if (!state.save(crystal, detector))
+	{
+		std::cout << path << ": " << state.getError() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool predictFrame(std::string frame, std::string stateFile,
+                  double resolution, BravaisLatticeType lattice,
+                  bool searchSpots, bool geometry)
+{
+	Crystal crystal;
+	Detector detector;
+	detector.setCrystal(&crystal);
+	crystal.setResolution(resolution);
+	crystal.setBravaisLattice(lattice);
+
+	StateFile state = StateFile(stateFile);
+
+	if (!state.load(&crystal, &detector))
+	{
+		std::cout << stateFile << ": " << state.getError() << std::endl;
+		return false;
+	}
+
+	bool unitCell = state.hasUnitCell();
+	std::string override = frameStateFile(frame);
+
+	if (override != stateFile && file_exists(override))
+	{
+		StateFile frameState = StateFile(override);
+
+		if (!frameState.load(&crystal, &detector))
+		{
+			std::cout << override << ": " << frameState.getError()
+			<< std::endl;
+			return false;
+		}
+
+		unitCell |= frameState.hasUnitCell();
+	}
+
+	/* The identity cell would give meaningless predictions */
+	if (!unitCell)
+	{
+		std::cout << frame << ": no unitcell line in " << stateFile
+		<< ", so there is nothing to predict from." << std::endl;
+		return false;
+	}
+
+	if (searchSpots && !searchOrientation(frame, &crystal, &detector,
+	                                      geometry))
+	{
+		return false;
+	}
+
+	crystal.populateMillers();
+	detector.calculatePositions();
+
+	vec3 centre = detector.getBeamCentre();
+	std::string path = frameOutputFile(frame, "_predictions.csv");
+
+	std::ofstream csv;
+	csv.open(path.c_str());
+
+	if (!csv.is_open())
+	{
+		std::cout << "Could not open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	csv << "h,k,l,x,y,weight" << std::endl;
+	int count = 0;
+
+	for (size_t i = 0; i < crystal.millerCount(); i++)
+	{
+		if (!crystal.shouldDisplayMiller(i))
+		{
+			continue;
+		}
+
+		int h, k, l;
+		crystal.getMillerHKL(i, &h, &k, &l);
+		vec3 pos = crystal.position(i);
+
+		csv << h << "," << k << "," << l << ",";
+		csv << std::fixed << std::setprecision(2);
+		csv << pos.x + centre.x << "," << pos.y + centre.y << ",";
+		csv << std::setprecision(4) << crystal.weightForMiller(i);
+		csv << std::defaultfloat << std::endl;
+		count++;
+	}
+
+	csv.close();
+
+	std::cout << frame << ": " << count << " predictions written to "
+	<< path << std::endl;
+
+	return true;
+}
+
+int main(int argc, char * argv[])
+{
+	std::vector<std::string> frames;
+	std::string stateFile;
+	double resolution = STARTING_RESOLUTION;
+	BravaisLatticeType lattice = BravaisLatticePrimitive;
+	bool searchSpots = false;
+	bool geometry = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+
+		if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else if (arg == "-l" && hasValue)
+		{
+			std::string list = get_file_contents(argv[++i]);
+			std::vector<std::string> lines = split(list, '\n');
+
+			for (size_t j = 0; j < lines.size(); j++)
+			{
+				trim(lines[j]);
+
+				if (lines[j].length())
+				{
+					frames.push_back(lines[j]);
+				}
+			}
+		}
+		else if (arg == "-o" && hasValue)
+		{
+			FileReader::setOutputDirectory(argv[++i]);
+		}
+		else if (arg == "-r" && hasValue)
+		{
+			resolution = atof(argv[++i]);
+		}
+		else if (arg == "-b" && hasValue)
+		{
+			if (!latticeFromString(argv[++i], &lattice))
+			{
+				std::cout << "Unknown lattice " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "-s")
+		{
+			searchSpots = true;
+		}
+		else if (arg == "-g")
+		{
+			geometry = true;
+		}
+		else if (!stateFile.length())
+		{
+			stateFile = arg;
+		}
+		else
+		{
+			frames.push_back(arg);
+		}
+	}
+
+	if (!stateFile.length() || frames.size() == 0 || resolution <= 0 ||
+	    (geometry && !searchSpots))
+	{
+		usage();
+		return 1;
+	}
+
+	int failures = 0;
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		if (!predictFrame(frames[i], stateFile, resolution, lattice,
+		                  searchSpots, geometry))
+		{
+			failures++;
+		}
+	}
+
+	std::cout << "Processed " << frames.size() - failures << " of "
+	<< frames.size() << " frames." << std::endl;
+
+	return (failures > 0);
+}
@@ -0,0 +1,610 @@
+// Mandexing: a manual indexing program for crystallographic data.
+// Copyright (C) 2017-2018 Helen Ginn
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// 
+// Please email: vagabond @ hginn.co.uk for more details.
+/* mandexing-bench: times the prediction and refinement hot paths on
+ * synthetic crystals, writing the results as JSON and/or CSV so that runs
+ * can be compared. Every crystal, orientation and query is fixed, so two
+ * runs on one machine differ only by timing noise. */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <cmath>
+#include "Crystal.h"
+#include "Detector.h"
+#include "RefinementNelderMead.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "FileReader.h"
+
+#define BENCH_WAVELENGTH 1.0
+#define BENCH_DISTANCE 2000
+#define BENCH_BEAM_CENTRE 2048
+#define BENCH_QUERIES 20000
+#define BENCH_WATCHED 40
+#define BENCH_MAX_PIXEL_ERROR 0.05
+#define BENCH_PANEL_COLUMNS 4
+#define BENCH_PANEL_ROWS 8
+#define BENCH_PANEL_WIDTH 1030
+#define BENCH_PANEL_HEIGHT 514
+#define BENCH_PANEL_GAP_X 10
+#define BENCH_PANEL_GAP_Y 37
+
+typedef struct
+{
+	std::string name;
+	double a, b, c;
+	double alpha, beta, gamma;
+	double resolution;
+	double rlpSize;
+	int repeats;
+} BenchCell;
+
+/* Small and medium protein cells, and a large virus-like one at a lower
+ * resolution; repeats are chosen for runs of a few seconds in all */
+static BenchCell bench_cells[] =
+{
+	{"small", 40, 50, 60, 90, 90, 90, 1.5, 0.0015, 200},
+	{"medium", 100, 120, 150, 90, 95, 90, 2.0, 0.0010, 100},
+	{"large", 500, 500, 500, 90, 90, 90, 3.0, 0.0005, 20},
+};
+
+typedef struct
+{
+	std::string name;
+	BravaisLatticeType type;
+} BenchLattice;
+
+static BenchLattice bench_lattices[] =
+{
+	{"P", BravaisLatticePrimitive},
+	{"C", BravaisLatticeBase},
+	{"I", BravaisLatticeBody},
+	{"F", BravaisLatticeFace},
+};
+
+typedef struct
+{
+	std::string crystal;
+	std::string benchmark;
+	size_t items;
+	int repeats;
+	double minMs;
+	double medianMs;
+	double meanMs;
+	double value;
+	bool failed;
+} BenchResult;
+
+void usage()
+{
+	std::cout << "Usage: mandexing-bench [options]" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  -j <file>    write results as JSON" << std::endl;
+	std::cout << "  -c <file>    write results as CSV" << std::endl;
+	std::cout << "  -n <count>   repeats per benchmark (default depends on "\
+	"the cell size)" << std::endl;
+	std::cout << "  -k <text>    only run crystals whose name contains this, "\
+	"e.g. small or large-F" << std::endl;
+	std::cout << "  -t <file>    also record the library's timed scopes as "\
+	"a Chrome trace" << std::endl;
+}
+
+/* Times repeats calls of job after one untimed call, which also sets up
+ * whatever the later calls rely on */
+BenchResult timeJob(std::string crystal, std::string benchmark,
+                    int repeats, std::function<size_t()> job)
+{
+	BenchResult result;
+	result.crystal = crystal;
+	result.benchmark = benchmark;
+	result.repeats = repeats;
+	result.value = 0;
+	result.failed = false;
+	result.items = job();
+
+	std::vector<double> times;
+
+	for (int i = 0; i < repeats; i++)
+	{
+		std::chrono::steady_clock::time_point start;
+		start = std::chrono::steady_clock::now();
+		result.items = job();
+		std::chrono::duration<double, std::milli> elapsed;
+		elapsed = std::chrono::steady_clock::now() - start;
+		times.push_back(elapsed.count());
+	}
+
+	std::sort(times.begin(), times.end());
+	double sum = 0;
+
+	for (size_t i = 0; i < times.size(); i++)
+	{
+		sum += times[i];
+	}
+
+	result.minMs = times[0];
+	result.medianMs = times[times.size() / 2];
+	result.meanMs = sum / times.size();
+
+	return result;
+}
+
+/* Largest distance in pixels between the positions from the double
+ * precision pass and those from the single precision one, which has
+ * redone the rotation, shell test and projection from h, k and l, over
+ * reflections on the image in both. Reflections at the very edge of the
+ * shell may change visibility through rounding; more than one in a
+ * thousand doing so counts as a failure too. */
+BenchResult comparePositions(std::string crystal, ReflectionList *refls,
+                             std::vector<double> &refX,
+                             std::vector<double> &refY,
+                             std::vector<unsigned char> &refFlags)
+{
+	BenchResult result;
+	result.crystal = crystal;
+	result.benchmark = "singlePrecisionError";
+	result.repeats = 0;
+	result.minMs = 0;
+	result.medianMs = 0;
+	result.meanMs = 0;
+	result.items = 0;
+	result.value = 0;
+
+	size_t flipped = 0;
+
+	for (size_t i = 0; i < refls->size(); i++)
+	{
+		bool was = (refFlags[i] & ReflectionOnImage);
+		bool is = (refls->flags[i] & ReflectionOnImage);
+
+		if (was != is)
+		{
+			flipped++;
+		}
+
+		if (!was || !is)
+		{
+			continue;
+		}
+
+		double dx = refls->posX[i] - refX[i];
+		double dy = refls->posY[i] - refY[i];
+		result.value = std::max(result.value, sqrt(dx * dx + dy * dy));
+		result.items++;
+	}
+
+	result.failed = (result.value > BENCH_MAX_PIXEL_ERROR ||
+	                 flipped * 1000 > refls->size());
+
+	if (result.failed)
+	{
+		std::cout << crystal << ": single precision is off by "
+		<< result.value << " pixels, with " << flipped
+		<< " reflections changing visibility." << std::endl;
+	}
+
+	return result;
+}
+
+/* Modules laid out as on a large pixel-array detector, each tilted
+ * slightly about its own vertical axis */
+void addBenchPanels(Detector *detector)
+{
+	for (int j = 0; j < BENCH_PANEL_ROWS; j++)
+	{
+		for (int i = 0; i < BENCH_PANEL_COLUMNS; i++)
+		{
+			double tilt = (i % 2 ? 0.002 : -0.002);
+			DetectorPanel panel = make_flat_panel();
+			panel.imageX = i * (BENCH_PANEL_WIDTH + BENCH_PANEL_GAP_X);
+			panel.imageY = j * (BENCH_PANEL_HEIGHT + BENCH_PANEL_GAP_Y);
+			panel.corner = make_vec3(panel.imageX, panel.imageY, 0);
+			panel.fast = make_vec3(cos(tilt), 0, sin(tilt));
+			panel.width = BENCH_PANEL_WIDTH;
+			panel.height = BENCH_PANEL_HEIGHT;
+			detector->addPanel(panel);
+		}
+	}
+}
+
+/* Watches the reflections closest to the Ewald sphere, tilts the crystal
+ * away from them and refines it back, as the GUI does */
+double refineBack(Crystal *crystal, mat3x3 rotation)
+{
+	crystal->setRotation(rotation);
+	Crystal::setHorizontal(crystal, 0.003);
+	Crystal::setVertical(crystal, -0.002);
+
+	NelderMeadPtr mead = NelderMeadPtr(new NelderMead());
+	mead->setEvaluationFunction(Crystal::ewaldSphereClosenessScore, crystal);
+	mead->addParameter(crystal, Crystal::getHorizontal,
+	                   Crystal::setHorizontal, 0.002, 0.00002);
+	mead->addParameter(crystal, Crystal::getVertical,
+	                   Crystal::setVertical, 0.002, 0.00002);
+	mead->setCycles(30);
+	mead->setSilent(true);
+	mead->refine();
+
+	return Crystal::ewaldSphereClosenessScore(crystal);
+}
+
+void benchCrystal(BenchCell &cell, BenchLattice &lattice, int repeats,
+                  std::vector<BenchResult> *results)
+{
+	std::string name = cell.name + "-" + lattice.name;
+	Crystal crystal;
+	Detector detector;
+	detector.setCrystal(&crystal);
+	detector.setWavelength(BENCH_WAVELENGTH);
+	detector.setBeamCentre(BENCH_BEAM_CENTRE, BENCH_BEAM_CENTRE);
+	detector.setDetectorDistance(BENCH_DISTANCE);
+
+	std::vector<double> dims;
+	dims.push_back(cell.a);
+	dims.push_back(cell.b);
+	dims.push_back(cell.c);
+	dims.push_back(cell.alpha);
+	dims.push_back(cell.beta);
+	dims.push_back(cell.gamma);
+
+	crystal.setUnitCell(dims);
+	crystal.setBravaisLattice(lattice.type);
+	crystal.setResolution(cell.resolution);
+	crystal.setRlpSize(cell.rlpSize);
+	crystal.setWavelength(BENCH_WAVELENGTH);
+
+	/* A general orientation, so that no axis lines up with the beam */
+	mat3x3 rotation = crystal.getNudge(0.4, -0.7, 1.1);
+	crystal.setRotation(rotation);
+
+	if (repeats <= 0)
+	{
+		repeats = cell.repeats;
+	}
+
+	results->push_back(timeJob(name, "populateMillers", repeats, [&]()
+	{
+		crystal.populateMillers();
+		return crystal.millerCount();
+	}));
+
+	/* Stepping the resolution out and back, as when checking high
+	 * angle spots, should only slice the stored reflections */
+	int step = 0;
+
+	results->push_back(timeJob(name, "applyResolution", repeats, [&]()
+	{
+		step++;
+		crystal.applyResolution(cell.resolution * (step % 2 ? 1.1 : 1));
+		return crystal.millerCount();
+	}));
+
+	crystal.applyResolution(cell.resolution);
+
+	/* Likewise a wavelength sweep should only recheck the shell */
+	results->push_back(timeJob(name, "applyWavelength", repeats, [&]()
+	{
+		step++;
+		crystal.applyWavelength(BENCH_WAVELENGTH * (step % 2 ? 1.0001 : 1));
+		return crystal.millerCount();
+	}));
+
+	crystal.applyWavelength(BENCH_WAVELENGTH);
+
+	results->push_back(timeJob(name, "quickCheckMillers", repeats, [&]()
+	{
+		crystal.quickCheckMillers();
+		return crystal.millerCount();
+	}));
+
+	results->push_back(timeJob(name, "calculatePositions", repeats, [&]()
+	{
+		detector.calculatePositions();
+		return crystal.millerCount();
+	}));
+
+	/* Single precision must put the spots in the same place, to well
+	 * under a pixel, as double precision does */
+	ReflectionList *refls = crystal.reflections();
+	std::vector<double> refX = refls->posX;
+	std::vector<double> refY = refls->posY;
+	std::vector<unsigned char> refFlags = refls->flags;
+	refls->setPrecision(PrecisionSingle);
+
+	results->push_back(timeJob(name, "quickCheckMillers-f32", repeats, [&]()
+	{
+		crystal.quickCheckMillers();
+		return crystal.millerCount();
+	}));
+
+	results->push_back(timeJob(name, "calculatePositions-f32", repeats, [&]()
+	{
+		detector.calculatePositions();
+		return crystal.millerCount();
+	}));
+
+	results->push_back(comparePositions(name, refls, refX, refY, refFlags));
+
+	refls->setPrecision(PrecisionDouble);
+
+	/* Reflections in the gaps are taken off the image, so the shell is
+	 * checked again once the panels are gone */
+	addBenchPanels(&detector);
+
+	results->push_back(timeJob(name, "calculatePositions-panels", repeats, [&]()
+	{
+		detector.calculatePositions();
+		return crystal.millerCount();
+	}));
+
+	detector.clearPanels();
+	crystal.quickCheckMillers();
+	detector.calculatePositions();
+
+	results->push_back(timeJob(name, "prepareLookupTable", repeats, [&]()
+	{
+		detector.prepareLookupTable();
+		return crystal.millerCount();
+	}));
+
+	/* Half the queries land near a reflection, half anywhere */
+	std::vector<int> onImage;
+
+	for (size_t i = 0; i < refls->size(); i++)
+	{
+		if (refls->flags[i] & ReflectionOnImage)
+		{
+			onImage.push_back(i);
+		}
+	}
+
+	std::mt19937 random(1);
+	std::vector<std::pair<int, int> > queries;
+
+	for (int i = 0; i < BENCH_QUERIES; i++)
+	{
+		int x = random() % (2 * BENCH_BEAM_CENTRE);
+		int y = random() % (2 * BENCH_BEAM_CENTRE);
+
+		if (i % 2 == 0 && onImage.size())
+		{
+			int j = onImage[random() % onImage.size()];
+			x = refls->posX[j] + BENCH_BEAM_CENTRE + (int)(random() % 7) - 3;
+			y = refls->posY[j] + BENCH_BEAM_CENTRE + (int)(random() % 7) - 3;
+		}
+
+		queries.push_back(std::make_pair(x, y));
+	}
+
+	int found = 0;
+
+	results->push_back(timeJob(name, "positionNearCoord", repeats, [&]()
+	{
+		found = 0;
+
+		for (size_t i = 0; i < queries.size(); i++)
+		{
+			found += (detector.positionNearCoord(queries[i].first,
+			                                     queries[i].second) >= 0);
+		}
+
+		return queries.size();
+	}));
+
+	results->back().value = found;
+
+	/* The reflections nearest the sphere at the true orientation */
+	std::vector<std::pair<double, int> > closest;
+
+	for (size_t i = 0; i < onImage.size(); i++)
+	{
+		closest.push_back(std::make_pair(refls->weight[onImage[i]],
+		                                 onImage[i]));
+	}
+
+	std::sort(closest.begin(), closest.end());
+
+	for (size_t i = 0; i < closest.size() && i < BENCH_WATCHED; i++)
+	{
+		crystal.toggleWatched(closest[i].second);
+	}
+
+	double score = 0;
+
+	results->push_back(timeJob(name, "NelderMead", repeats, [&]()
+	{
+		score = refineBack(&crystal, rotation);
+		return crystal.watchedReflections().size();
+	}));
+
+	results->back().value = score;
+}
+
+void writeJson(std::ostream &out, std::vector<BenchResult> &results)
+{
+	out << "{" << std::endl;
+	out << "  \"threads\": " << thread_count() << "," << std::endl;
+	out << "  \"results\": [" << std::endl;
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		BenchResult &r = results[i];
+		double perItem = (r.items ? r.medianMs * 1e6 / r.items : 0);
+
+		out << "    {\"crystal\": \"" << r.crystal << "\", "
+		<< "\"benchmark\": \"" << r.benchmark << "\", "
+		<< "\"items\": " << r.items << ", "
+		<< "\"repeats\": " << r.repeats << ", "
+		<< "\"min_ms\": " << r.minMs << ", "
+		<< "\"median_ms\": " << r.medianMs << ", "
+		<< "\"mean_ms\": " << r.meanMs << ", "
+		<< "\"ns_per_item\": " << perItem << ", "
+		<< "\"value\": " << std::scientific << r.value << std::fixed << "}"
+		<< (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
+
+void writeCsv(std::ostream &out, std::vector<BenchResult> &results)
+{
+	out << "crystal,benchmark,items,repeats,min_ms,median_ms,mean_ms,"\
+	"ns_per_item,value" << std::endl;
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		BenchResult &r = results[i];
+		double perItem = (r.items ? r.medianMs * 1e6 / r.items : 0);
+
+		out << r.crystal << "," << r.benchmark << "," << r.items << ","
+		<< r.repeats << "," << r.minMs << "," << r.medianMs << ","
+		<< r.meanMs << "," << perItem << "," << r.value << std::endl;
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	std::string jsonFile;
+	std::string csvFile;
+	std::string filter;
+	std::string traceFile;
+	int repeats = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+
+		if (arg == "-h" || arg == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else if (arg == "-j" && hasValue)
+		{
+			jsonFile = argv[++i];
+		}
+		else if (arg == "-c" && hasValue)
+		{
+			csvFile = argv[++i];
+		}
+		else if (arg == "-n" && hasValue)
+		{
+			repeats = atoi(argv[++i]);
+		}
+		else if (arg == "-k" && hasValue)
+		{
+			filter = argv[++i];
+		}
+		else if (arg == "-t" && hasValue)
+		{
+			traceFile = argv[++i];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	bool failed = false;
+	size_t cellCount = sizeof(bench_cells) / sizeof(bench_cells[0]);
+	size_t latticeCount = sizeof(bench_lattices) / sizeof(bench_lattices[0]);
+
+	/* Progress messages from the library would be timed too */
+	trace_set_level(TraceWarning);
+
+	if (traceFile.length())
+	{
+		trace_start();
+	}
+
+	std::ostream &out = std::cout;
+	out << std::fixed << std::setprecision(3);
+
+	for (size_t i = 0; i < cellCount; i++)
+	{
+		for (size_t j = 0; j < latticeCount; j++)
+		{
+			std::string name = bench_cells[i].name + "-" +
+			bench_lattices[j].name;
+
+			if (filter.length() && name.find(filter) == std::string::npos)
+			{
+				continue;
+			}
+
+			size_t first = results.size();
+			benchCrystal(bench_cells[i], bench_lattices[j], repeats, &results);
+
+			for (size_t k = first; k < results.size(); k++)
+			{
+				failed |= results[k].failed;
+				out << std::setw(10) << std::left << results[k].crystal
+				<< std::setw(20) << results[k].benchmark << std::right
+				<< std::setw(10) << results[k].items << " items ";
+
+				/* Checks are not timed, so their value is shown instead */
+				if (results[k].repeats == 0)
+				{
+					out << std::setw(10) << std::scientific << std::setprecision(2)
+					<< results[k].value << " px" << std::endl;
+					out << std::fixed << std::setprecision(3);
+				}
+				else
+				{
+					out << std::setw(10) << results[k].medianMs << " ms" << std::endl;
+				}
+			}
+		}
+	}
+
+	if (traceFile.length() && !trace_export(traceFile))
+	{
+		std::cout << "Could not write " << traceFile << std::endl;
+	}
+
+	if (jsonFile.length())
+	{
+		std::ofstream json(jsonFile.c_str());
+		writeJson(json, results);
+	}
+
+	if (csvFile.length())
+	{
+		std::ofstream csv(csvFile.c_str());
+		writeCsv(csv, results);
+	}
+
+	if (!jsonFile.length() && !csvFile.length())
+	{
+		writeJson(out, results);
+	}
+
+	return (failed ? 1 : 0);
+}
@@ -27,67 +27,7 @@
 #include <vector>
 #include <iostream>
 
-struct mat3x3 make_mat3x3()
-{
-	struct mat3x3 mat;
-	memset(mat.vals, 0, 9 * sizeof(double));
-
-	mat.vals[0] = 1;
-	mat.vals[4] = 1;
-	mat.vals[8] = 1;
-	
-	return mat;
-}
-
-vec3 mat3x3_mult_vec(struct mat3x3 mat, struct vec3 vec)
-{
-	struct vec3 v;
-
-	v.x = mat.vals[0] * vec.x + mat.vals[1] * vec.y + mat.vals[2] * vec.z;
-	v.y = mat.vals[3] * vec.x + mat.vals[4] * vec.y + mat.vals[5] * vec.z;
-	v.z = mat.vals[6] * vec.x + mat.vals[7] * vec.y + mat.vals[8] * vec.z;
-
-	return v;
-}
-
-mat3x3 mat3x3_mult_mat3x3(struct mat3x3 m1, struct mat3x3 m2)
-{
-	mat3x3 m = make_mat3x3();
-
-	m.vals[0] = m1.vals[0] * m2.vals[0] + m1.vals[1] * m2.vals[3] + m1.vals[2] * m2.vals[6];
-	m.vals[1] = m1.vals[0] * m2.vals[1] + m1.vals[1] * m2.vals[4] + m1.vals[2] * m2.vals[7];
-	m.vals[2] = m1.vals[0] * m2.vals[2] + m1.vals[1] * m2.vals[5] + m1.vals[2] * m2.vals[8];
-
-	m.vals[3] = m1.vals[3] * m2.vals[0] + m1.vals[4] * m2.vals[3] + m1.vals[5] * m2.vals[6];
-	m.vals[4] = m1.vals[3] * m2.vals[1] + m1.vals[4] * m2.vals[4] + m1.vals[5] * m2.vals[7];
-	m.vals[5] = m1.vals[3] * m2.vals[2] + m1.vals[4] * m2.vals[5] + m1.vals[5] * m2.vals[8];
-
-	m.vals[6] = m1.vals[6] * m2.vals[0] + m1.vals[7] * m2.vals[3] + m1.vals[8] * m2.vals[6];
-	m.vals[7] = m1.vals[6] * m2.vals[1] + m1.vals[7] * m2.vals[4] + m1.vals[8] * m2.vals[7];
-	m.vals[8] = m1.vals[6] * m2.vals[2] + m1.vals[7] * m2.vals[5] + m1.vals[8] * m2.vals[8];
-
-	return m;
-}
-
-double mat3x3_determinant(mat3x3 &mat)
-{
-	double a = mat.vals[0];
-	double b = mat.vals[1];
-	double c = mat.vals[2];
-	double d = mat.vals[3];
-	double e = mat.vals[4];
-	double f = mat.vals[5];
-	double g = mat.vals[6];
-	double h = mat.vals[7];
-	double i = mat.vals[8];
-
-	double det = a*e*i + b*f*g + c*d*h - c*e*g - b*d*i - a*f*h;
-
-	return det;
-}
-
-
-mat3x3 mat3x3_inverse(mat3x3 &mat)
+mat3x3 mat3x3_inverse(const mat3x3 &mat)
 {
 	double a = mat.vals[0];
 	double b = mat.vals[1];
@@ -123,7 +63,7 @@ mat3x3 mat3x3_from_unit_cell(double *unitCell)
 								 unitCell[4], unitCell[5]);
 }
 
-void unit_cell_from_mat3x3(mat3x3 mat, double *vals)
+void unit_cell_from_mat3x3(const mat3x3 &mat, double *vals)
 {
 	vec3 a = mat3x3_axis(mat, 0);
 	vec3 b = mat3x3_axis(mat, 1);
@@ -176,22 +116,6 @@ mat3x3 mat3x3_from_unit_cell(double a, double b, double c, double alpha, double
 	return mat;
 }
 
-mat3x3 mat3x3_transpose(mat3x3 &mat)
-{
-	mat3x3 new_mat = make_mat3x3();
-	new_mat.vals[0] = mat.vals[0];
-	new_mat.vals[1] = mat.vals[3];
-	new_mat.vals[2] = mat.vals[6];
-	new_mat.vals[3] = mat.vals[1];
-	new_mat.vals[4] = mat.vals[4];
-	new_mat.vals[5] = mat.vals[7];
-	new_mat.vals[6] = mat.vals[2];
-	new_mat.vals[7] = mat.vals[5];
-	new_mat.vals[8] = mat.vals[8];
-
-	return new_mat;
-}
-
 void mat3x3_scale(mat3x3 *inverse, double a, double b, double c)
 {
 	inverse->vals[0] *= a;
@@ -207,7 +131,7 @@ void mat3x3_scale(mat3x3 *inverse, double a, double b, double c)
 	inverse->vals[8] *= c;
 }
 
-double mat3x3_length(mat3x3 &mat, int index)
+double mat3x3_length(const mat3x3 &mat, int index)
 {
 	double sqLength = mat.vals[index * 3 + 0] * mat.vals[index * 3 + 0]
 	+ mat.vals[index * 3 + 1] * mat.vals[index * 3 + 1]
@@ -370,15 +294,7 @@ mat3x3 mat3x3_closest_rot_mat(vec3 vec1, vec3 vec2, vec3 axis, double *best)
 	}
 }
 
-vec3 mat3x3_axis(mat3x3 me, int i)
-{
-	vec3 axis;
-	axis = make_vec3(me.vals[0 + i], me.vals[3 + i], me.vals[6 + i]);
-
-	return axis;
-}
-
-std::string mat3x3_desc(mat3x3 mat)
+std::string mat3x3_desc(const mat3x3 &mat)
 {
 	std::ostringstream str;
 	str << "(" << mat.vals[0] << ", " << mat.vals[1] << ", " << mat.vals[2] << ",\n";
@@ -403,7 +319,7 @@ mat3x3 mat3x3_from_2d_array(double **values)
 	return new_mat;
 }
 
-void mat3x3_to_2d_array(mat3x3 mat, double ***values)
+void mat3x3_to_2d_array(const mat3x3 &mat, double ***values)
 {
 	*values = (double **)malloc(sizeof(double *) * 3);
 
@@ -428,7 +344,7 @@ void free_2d_array(double **values)
 	free(values);
 }
 
-mat3x3 mat3x3_covariance(std::vector<vec3> points)
+mat3x3 mat3x3_covariance(const std::vector<vec3> &points)
 {
 	mat3x3 mat = make_mat3x3();
 	memset(mat.vals, 0, sizeof(double) * 9);
@@ -442,18 +358,15 @@ mat3x3 mat3x3_covariance(std::vector<vec3> points)
 
 	vec3_mult(&mean, 1 / (double)points.size());
 
-	for (size_t i = 0; i < points.size(); i++)
+	for (size_t k = 0; k < points.size(); k++)
 	{
-		points[i] = vec3_subtract_vec3(points[i], mean);
-	}
+		vec3 centred = vec3_subtract_vec3(points[k], mean);
 
-	for (int j = 0; j < 3; j++)
-	{
-		for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
 		{
-			for (size_t k = 0; k < points.size(); k++)
+			for (int i = 0; i < 3; i++)
 			{
-				double add = *(&points[k].x + i) * *(&points[k].x + j);
+				double add = *(&centred.x + i) * *(&centred.x + j);
 				mat.vals[j * 3 + i] += add;
 			}
 		}
@@ -462,7 +375,7 @@ mat3x3 mat3x3_covariance(std::vector<vec3> points)
 	return mat;
 }
 
-std::string computer_friendly_desc(mat3x3 &mat)
+std::string computer_friendly_desc(const mat3x3 &mat)
 {
 	std::ostringstream str;
 	
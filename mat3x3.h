@@ -29,39 +29,73 @@ struct mat3x3
 	double vals[9];
 };
 
-std::string mat3x3_desc(mat3x3 mat);
+inline constexpr mat3x3 make_mat3x3()
+{
+	return mat3x3{{1, 0, 0, 0, 1, 0, 0, 0, 1}};
+}
 
-mat3x3 mat3x3_inverse(mat3x3 &mat);
+std::string mat3x3_desc(const mat3x3 &mat);
+
+mat3x3 mat3x3_inverse(const mat3x3 &mat);
 mat3x3 mat3x3_from_unit_cell(double a, double b, double c, double alpha, double beta, double gamma);
 mat3x3 mat3x3_from_unit_cell(double *unitCell);
 
 void mat3x3_mult_scalar(mat3x3 *mat, double scale);
-void unit_cell_from_mat3x3(mat3x3 mat, double *vals);
-mat3x3 make_mat3x3();
+void unit_cell_from_mat3x3(const mat3x3 &mat, double *vals);
 
-std::string computer_friendly_desc(mat3x3 &mat);
+std::string computer_friendly_desc(const mat3x3 &mat);
 mat3x3 mat3x3_from_string(std::vector<std::string> &components);
 
-inline void mat3x3_mult_vec(struct mat3x3 mat, struct vec3 *vec)
+inline constexpr vec3 mat3x3_mult_vec(const mat3x3 &mat, const vec3 &vec)
+{
+	return vec3{mat.vals[0] * vec.x + mat.vals[1] * vec.y + mat.vals[2] * vec.z,
+	            mat.vals[3] * vec.x + mat.vals[4] * vec.y + mat.vals[5] * vec.z,
+	            mat.vals[6] * vec.x + mat.vals[7] * vec.y + mat.vals[8] * vec.z};
+}
+
+inline void mat3x3_mult_vec(const mat3x3 &mat, vec3 *vec)
+{
+	*vec = mat3x3_mult_vec(mat, *vec);
+}
+
+/* Column i of the matrix */
+inline constexpr vec3 mat3x3_axis(const mat3x3 &me, int i)
+{
+	return vec3{me.vals[i], me.vals[i + 3], me.vals[i + 6]};
+}
+
+inline constexpr mat3x3 mat3x3_mult_mat3x3(const mat3x3 &m1, const mat3x3 &m2)
 {
-	struct vec2 v;
+	return mat3x3{{
+	m1.vals[0] * m2.vals[0] + m1.vals[1] * m2.vals[3] + m1.vals[2] * m2.vals[6],
+	m1.vals[0] * m2.vals[1] + m1.vals[1] * m2.vals[4] + m1.vals[2] * m2.vals[7],
+	m1.vals[0] * m2.vals[2] + m1.vals[1] * m2.vals[5] + m1.vals[2] * m2.vals[8],
 
-	v.x = mat.vals[0] * vec->x + mat.vals[1] * vec->y + mat.vals[2] * vec->z;
-	v.y = mat.vals[3] * vec->x + mat.vals[4] * vec->y + mat.vals[5] * vec->z;
-	vec->z = mat.vals[6] * vec->x + mat.vals[7] * vec->y + mat.vals[8] * vec->z;
+	m1.vals[3] * m2.vals[0] + m1.vals[4] * m2.vals[3] + m1.vals[5] * m2.vals[6],
+	m1.vals[3] * m2.vals[1] + m1.vals[4] * m2.vals[4] + m1.vals[5] * m2.vals[7],
+	m1.vals[3] * m2.vals[2] + m1.vals[4] * m2.vals[5] + m1.vals[5] * m2.vals[8],
 
-	memcpy(vec, &v.x, sizeof(double) * 2);
+	m1.vals[6] * m2.vals[0] + m1.vals[7] * m2.vals[3] + m1.vals[8] * m2.vals[6],
+	m1.vals[6] * m2.vals[1] + m1.vals[7] * m2.vals[4] + m1.vals[8] * m2.vals[7],
+	m1.vals[6] * m2.vals[2] + m1.vals[7] * m2.vals[5] + m1.vals[8] * m2.vals[8]}};
 }
 
-vec3 mat3x3_axis(mat3x3 me, int i);
+inline constexpr mat3x3 mat3x3_transpose(const mat3x3 &mat)
+{
+	return mat3x3{{mat.vals[0], mat.vals[3], mat.vals[6],
+	               mat.vals[1], mat.vals[4], mat.vals[7],
+	               mat.vals[2], mat.vals[5], mat.vals[8]}};
+}
 
-vec3 mat3x3_mult_vec(struct mat3x3 mat, struct vec3 vec);
+inline constexpr double mat3x3_determinant(const mat3x3 &m)
+{
+	return (m.vals[0] * m.vals[4] * m.vals[8] + m.vals[1] * m.vals[5] * m.vals[6]
+	        + m.vals[2] * m.vals[3] * m.vals[7] - m.vals[2] * m.vals[4] * m.vals[6]
+	        - m.vals[1] * m.vals[3] * m.vals[8] - m.vals[0] * m.vals[5] * m.vals[7]);
+}
 
 void mat3x3_scale(mat3x3 *mat, double a, double b, double c);
-double mat3x3_length(mat3x3 &mat, int index);
-mat3x3 mat3x3_transpose(mat3x3 &mat);
-double mat3x3_determinant(mat3x3 &mat);
-mat3x3 mat3x3_mult_mat3x3(struct mat3x3 m1, struct mat3x3 m2);
+double mat3x3_length(const mat3x3 &mat, int index);
 mat3x3 mat3x3_unit_vec_rotation(vec3 axis, double radians);
 mat3x3 mat3x3_rotate(double alpha, double beta, double gamma);
 mat3x3 mat3x3_ortho_axes(vec3 cVec);
@@ -69,11 +103,11 @@ mat3x3 mat3x3_rhbasis(vec3 aVec, vec3 cVec);
 mat3x3 mat3x3_map_vec_to_vec(vec3 aVec, vec3 bVec);
 mat3x3 mat3x3_closest_rot_mat(vec3 vec1, vec3 vec2, vec3 axis,
 							  double *best = NULL);
-mat3x3 mat3x3_covariance(std::vector<vec3> points);
+mat3x3 mat3x3_covariance(const std::vector<vec3> &points);
 
 mat3x3 mat3x3_rot_from_angles(double phi, double psi);
 mat3x3 mat3x3_from_2d_array(double **values);
-void mat3x3_to_2d_array(mat3x3 mat, double ***values);
+void mat3x3_to_2d_array(const mat3x3 &mat, double ***values);
 void free_2d_array(double **values);
 
 #endif /* defined(__vagabond__mat3x3__) */
@@ -32,17 +32,27 @@ class RefinementGridSearch;
 class RefinementStepSearch;
 class RefinementStrategy;
 class NelderMead;
+class LevenbergMarquardt;
 typedef boost::shared_ptr<RefinementStepSearch> RefinementStepSearchPtr;
 typedef boost::shared_ptr<RefinementGridSearch> RefinementGridSearchPtr;
 typedef boost::shared_ptr<RefinementStrategy> RefinementStrategyPtr;
 typedef boost::shared_ptr<NelderMead> NelderMeadPtr;
+typedef boost::shared_ptr<LevenbergMarquardt> LevenbergMarquardtPtr;
 
 class CSV;
+class ImageFrame;
+class ImagePyramid;
+class MappedFile;
+class FrameReader;
 class PNGFile;
 class TextManager;
 typedef boost::shared_ptr<PNGFile> PNGFilePtr;
 typedef boost::shared_ptr<TextManager> TextManagerPtr;
 typedef boost::shared_ptr<CSV> CSVPtr;
+typedef boost::shared_ptr<ImageFrame> ImageFramePtr;
+typedef boost::shared_ptr<ImagePyramid> ImagePyramidPtr;
+typedef boost::shared_ptr<MappedFile> MappedFilePtr;
+typedef boost::shared_ptr<FrameReader> FrameReaderPtr;
 
 
 typedef enum
@@ -22,7 +22,7 @@
 #include <iostream>
 #include <sstream>
 
-std::string computer_friendly_desc(vec3 &vec)
+std::string computer_friendly_desc(const vec3 &vec)
 {
 	std::ostringstream str;
 	str << vec.x << " " << vec.y << " " <<
@@ -45,7 +45,7 @@ vec3 vec3_from_string(std::vector<std::string> &components)
 }
 
 
-std::string vec3_desc(vec3 vec)
+std::string vec3_desc(const vec3 &vec)
 {
 	std::ostringstream str;
 	str << "(" << vec.x << ", " << vec.y <<
@@ -62,49 +62,12 @@ struct vec3 empty_vec3()
 	return vec;
 }
 
-double vec3_length(vec3 &vec)
-{
-	return sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
-}
-
-double vec3_sqlength(vec3 &vec)
-{
-	return (vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
-}
-
-struct vec3 vec3_subtract_vec3(vec3 &to, vec3 &from)
-{
-	struct vec3 vec;
-	vec.x = to.x - from.x;
-	vec.y = to.y - from.y;
-	vec.z = to.z - from.z;
-
-	return vec;
-}
-
-struct vec3 vec3_add_vec3(vec3 &aVec, vec3 &bVec)
-{
-	struct vec3 vec;
-	vec.x = aVec.x + bVec.x;
-	vec.y = aVec.y + bVec.y;
-	vec.z = aVec.z + bVec.z;
-
-	return vec;
-}
-
-double vec3_dot_vec3(vec3 &aVec, vec3 &bVec)
-{
-	double dot_prod = aVec.x * bVec.x + aVec.y * bVec.y + aVec.z * bVec.z;
-
-	return dot_prod;
-}
-
-double vec3_angle_with_vec3(vec3 &aVec, vec3 &bVec)
+double vec3_angle_with_vec3(const vec3 &aVec, const vec3 &bVec)
 {
 	return acos(vec3_cosine_with_vec3(aVec, bVec));
 }
 
-double vec3_cosine_with_vec3(vec3 &aVec, vec3 &bVec)
+double vec3_cosine_with_vec3(const vec3 &aVec, const vec3 &bVec)
 {
 	double dot_prod = aVec.x * bVec.x + aVec.y * bVec.y + aVec.z * bVec.z;
 	double vec1_length = vec3_length(aVec);
@@ -115,15 +78,6 @@ double vec3_cosine_with_vec3(vec3 &aVec, vec3 &bVec)
 	return cosTheta;
 }
 
-vec3 vec3_cross_vec3(vec3 &aVec, vec3 &bVec)
-{
-	double new_h = aVec.y * bVec.z - aVec.z * bVec.y;
-	double new_k = aVec.z * bVec.x - aVec.x * bVec.z;
-	double new_l = aVec.x * bVec.y - aVec.y * bVec.x;
-
-	return make_vec3(new_h, new_k, new_l);
-}
-
 vec3 make_randomish_axis()
 {
 	struct vec3 vec;
@@ -136,7 +90,8 @@ vec3 make_randomish_axis()
 	return vec;
 }
 
-double vec3_angle_from_three_points(vec3 &aVec, vec3 &bVec, vec3 &cVec)
+double vec3_angle_from_three_points(const vec3 &aVec, const vec3 &bVec,
+                                    const vec3 &cVec)
 {
 	vec3 aToB = vec3_subtract_vec3(bVec, aVec);
 	vec3 aToC = vec3_subtract_vec3(bVec, cVec);
@@ -144,7 +99,7 @@ double vec3_angle_from_three_points(vec3 &aVec, vec3 &bVec, vec3 &cVec)
 	return vec3_angle_with_vec3(aToB, aToC);
 }
 
-double ewald_wavelength(vec3 &index)
+double ewald_wavelength(const vec3 &index)
 {
     double ewald_radius = index.x * index.x + index.y * index.y
                         + index.z * index.z;
@@ -24,6 +24,7 @@
 #include <math.h>
 #include <string>
 #include <vector>
+#include <stddef.h>
 
 struct vec3
 {
@@ -38,59 +39,137 @@ struct vec2
 	double y;
 };
 
-double vec3_length(vec3 &vec);
-void vec3_set_length(vec3 *vec, double length);
-
 struct vec3 empty_vec3();
-inline vec3 make_vec3(double x, double y, double z)
+inline constexpr vec3 make_vec3(double x, double y, double z)
 {
-	struct vec3 vec;
-	vec.x = x;
-	vec.y = y;
-	vec.z = z;
-
-	return vec;
+	return vec3{x, y, z};
 }
 
 vec3 make_randomish_axis();
 
-inline vec2 make_vec2(double x, double y)
+inline constexpr vec2 make_vec2(double x, double y)
 {
-	struct vec2 vec;
-	vec.x = x;
-	vec.y = y;
-
-	return vec;
+	return vec2{x, y};
 }
 
-inline bool vec2_less_vec2(vec2 x, vec2 y)
+inline constexpr bool vec2_less_vec2(const vec2 &x, const vec2 &y)
 {
 	return x.x > y.x;
 }
 
+inline constexpr double vec3_sqlength(const vec3 &vec)
+{
+	return (vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
+}
 
-double vec3_sqlength(vec3 &vec);
-struct vec3 vec3_add_vec3(vec3 &aVec, vec3 &bVec);
-struct vec3 vec3_subtract_vec3(vec3 &to, vec3 &from);
-double vec3_dot_vec3(vec3 &aVec, vec3 &bVec);
-double vec3_angle_with_vec3(vec3 &aVec, vec3 &bVec);
-double vec3_cosine_with_vec3(vec3 &aVec, vec3 &bVec);
-vec3 vec3_cross_vec3(vec3 &aVec, vec3 &bVec);
-double vec3_angle_from_three_points(vec3 &aVec, vec3 &bVec, vec3 &cVec);
-double ewald_wavelength(vec3 &aVec);
+inline double vec3_length(const vec3 &vec)
+{
+	return sqrt(vec3_sqlength(vec));
+}
+
+inline constexpr vec3 vec3_add_vec3(const vec3 &aVec, const vec3 &bVec)
+{
+	return vec3{aVec.x + bVec.x, aVec.y + bVec.y, aVec.z + bVec.z};
+}
+
+inline constexpr vec3 vec3_subtract_vec3(const vec3 &to, const vec3 &from)
+{
+	return vec3{to.x - from.x, to.y - from.y, to.z - from.z};
+}
+
+inline constexpr double vec3_dot_vec3(const vec3 &aVec, const vec3 &bVec)
+{
+	return aVec.x * bVec.x + aVec.y * bVec.y + aVec.z * bVec.z;
+}
+
+inline constexpr vec3 vec3_cross_vec3(const vec3 &aVec, const vec3 &bVec)
+{
+	return vec3{aVec.y * bVec.z - aVec.z * bVec.y,
+	            aVec.z * bVec.x - aVec.x * bVec.z,
+	            aVec.x * bVec.y - aVec.y * bVec.x};
+}
+
+double vec3_angle_with_vec3(const vec3 &aVec, const vec3 &bVec);
+double vec3_cosine_with_vec3(const vec3 &aVec, const vec3 &bVec);
+double vec3_angle_from_three_points(const vec3 &aVec, const vec3 &bVec,
+                                    const vec3 &cVec);
+double ewald_wavelength(const vec3 &aVec);
 
 vec3 vec3_from_string(std::vector<std::string> &components);
-std::string computer_friendly_desc(vec3 &vec);
-std::string vec3_desc(vec3 vec);
+std::string computer_friendly_desc(const vec3 &vec);
+std::string vec3_desc(const vec3 &vec);
+
+/* Central projection of count points, held as separate coordinate
+ * arrays, onto the plane a distance along z from the origin:
+ * out = (p - origin) * distance / (p - origin).z. If flags are given,
+ * only points whose flags share a bit with the mask are written and the
+ * rest of the output is left as it was. The arithmetic is done in T, so
+ * float gives twice the vector width where double precision isn't
+ * needed. */
+template <typename T = double>
+void vec3_project_vecs(const double *x, const double *y, const double *z,
+                       size_t count, const vec3 &origin, double distance,
+                       const unsigned char *flags, unsigned char mask,
+                       double *outX, double *outY, double *outZ)
+{
+	const T ox = origin.x;
+	const T oy = origin.y;
+	const T oz = origin.z;
+	const T dist = distance;
+
+	/* Every point is projected and the mask chooses between the new and
+	 * the old value, so that the loop has no branches to vectorise */
+	for (size_t i = 0; i < count; i++)
+	{
+		T dx = (T)x[i] - ox;
+		T dy = (T)y[i] - oy;
+		T dz = (T)z[i] - oz;
+		T mult = dist / dz;
+		bool write = (flags == NULL || (flags[i] & mask));
+
+		outX[i] = write ? (double)(dx * mult) : outX[i];
+		outY[i] = write ? (double)(dy * mult) : outY[i];
+		outZ[i] = write ? (double)(dz * mult) : outZ[i];
+	}
+}
+
+/* Multiplies count points, held as separate coordinate arrays of any
+ * numeric type V, by a matrix given as the nine values of a mat3x3 in
+ * the same order. The arithmetic is done in T as above. The output must
+ * not overlap the input, which lets the loop vectorise. */
+template <typename T = double, typename V>
+void mat3x3_mult_vecs(const double *matrix, const V *__restrict x,
+                      const V *__restrict y, const V *__restrict z,
+                      size_t count, double *__restrict outX,
+                      double *__restrict outY, double *__restrict outZ)
+{
+	T m[9];
+
+	for (int j = 0; j < 9; j++)
+	{
+		m[j] = matrix[j];
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		T vx = x[i];
+		T vy = y[i];
+		T vz = z[i];
+
+		outX[i] = m[0] * vx + m[1] * vy + m[2] * vz;
+		outY[i] = m[3] * vx + m[4] * vy + m[5] * vz;
+		outZ[i] = m[6] * vx + m[7] * vy + m[8] * vz;
+	}
+}
 
-inline void vec3_min_each(vec3 *minVec, vec3 &aVec)
+inline void vec3_min_each(vec3 *minVec, const vec3 &aVec)
 {
 	if (aVec.x < minVec->x) minVec->x = aVec.x;
 	if (aVec.y < minVec->y) minVec->y = aVec.y;
 	if (aVec.z < minVec->z) minVec->z = aVec.z;
 }
 
-inline void vec3_max_each(vec3 *maxVec, vec3 &aVec)
+inline void vec3_max_each(vec3 *maxVec, const vec3 &aVec)
 {
 	if (aVec.x > maxVec->x) maxVec->x = aVec.x;
 	if (aVec.y > maxVec->y) maxVec->y = aVec.y;